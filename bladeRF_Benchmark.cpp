@@ -0,0 +1,377 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*!
+ * Streaming throughput and latency benchmark.
+ *
+ * Sweeps sample rate, buffers, buflen, transfers, format, and channel layout
+ * through the SoapySDR API and prints one line per configuration with the
+ * sustained rate, the CPU time per sample, overflow/underflow counts, and
+ * the p50/p99 readStream()/writeStream() call latency.
+ *
+ * The --mock mode needs no hardware: it runs the wire to stream format
+ * conversions that readStream() and writeStream() perform on every buffer.
+ */
+
+#include "bladeRF_Convert.hpp"
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//! Latency samples kept per configuration for the percentiles
+#define MAX_LATENCY_SAMPLES (1 << 20)
+
+struct BenchConfig
+{
+    std::string deviceArgs = "driver=bladerf";
+    bool mock = false;
+    int direction = SOAPY_SDR_RX;
+    std::string wire = "auto";
+    double seconds = 2.0;
+    std::vector<std::string> rates = {"10e6"};
+    std::vector<std::string> buffers = {"32"};
+    std::vector<std::string> buflens = {"4096"};
+    std::vector<std::string> transfers = {"0"};
+    std::vector<std::string> formats = {SOAPY_SDR_CS16, SOAPY_SDR_CF32, SOAPY_SDR_CS8};
+    std::vector<std::string> layouts = {"X1", "X2"};
+};
+
+struct BenchResult
+{
+    unsigned long long samples = 0;
+    unsigned long long overflows = 0;
+    unsigned long long underflows = 0;
+    unsigned long long errors = 0;
+    double wallSeconds = 0.0;
+    double cpuSeconds = 0.0;
+    unsigned long long calls = 0;
+    std::vector<double> latencyUs;
+
+    //! Keep a bounded uniform sample of the call latencies (reservoir sampling)
+    void addLatency(const double us)
+    {
+        calls++;
+        if (latencyUs.size() < MAX_LATENCY_SAMPLES) latencyUs.push_back(us);
+        else
+        {
+            const unsigned long long i = ((unsigned long long)(std::rand()) * RAND_MAX + std::rand()) % calls;
+            if (i < MAX_LATENCY_SAMPLES) latencyUs[i] = us;
+        }
+    }
+};
+
+static std::vector<std::string> splitList(const std::string &list)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) if (not item.empty()) out.push_back(item);
+    return out;
+}
+
+static double percentile(std::vector<double> &values, const double p)
+{
+    if (values.empty()) return 0.0;
+    const size_t i = std::min(values.size()-1, size_t(p*values.size()));
+    std::nth_element(values.begin(), values.begin()+i, values.end());
+    return values[i];
+}
+
+static void printUsage(void)
+{
+    std::cout << "Usage: bladeRFBenchmark [options]" << std::endl
+        << "  --args <kwargs>      device arguments (default driver=bladerf)" << std::endl
+        << "  --mock               benchmark the sample conversions without hardware" << std::endl
+        << "  --tx                 benchmark writeStream() instead of readStream()" << std::endl
+        << "  --time <seconds>     duration of each configuration (default 2)" << std::endl
+        << "  --rates <list>       sample rates (default 10e6)" << std::endl
+        << "  --buffers <list>     buffers stream arg values (default 32)" << std::endl
+        << "  --buflen <list>      buflen stream arg values (default 4096)" << std::endl
+        << "  --transfers <list>   transfers stream arg values (default 0)" << std::endl
+        << "  --formats <list>     stream formats (default CS16,CF32,CS8)" << std::endl
+        << "  --layouts <list>     channel layouts X1,X2 (default both)" << std::endl
+        << "  --wire <auto|sc16|sc8>  wire format stream arg (default auto)" << std::endl
+        << "Lists are comma separated, every combination is run." << std::endl;
+}
+
+static size_t formatBytes(const std::string &format)
+{
+    if (format == SOAPY_SDR_CF32) return 8;
+    if (format == SOAPY_SDR_CS8) return 2;
+    return 4;
+}
+
+/*******************************************************************
+ * Mock mode: the conversion hot path
+ ******************************************************************/
+
+static BenchResult runMock(const BenchConfig &config, const std::string &format, const size_t numChans, const size_t bufLen)
+{
+    const bool wire8 = (format == SOAPY_SDR_CS8) or (config.wire == "sc8");
+    const bool tx = (config.direction == SOAPY_SDR_TX);
+
+    //the wire buffer holds random samples within the valid range
+    std::vector<int16_t> wire16(bufLen*2*numChans);
+    std::vector<int8_t> wire8Buff(bufLen*2*numChans);
+    for (auto &x : wire16) x = int16_t((std::rand() % 4096) - 2048);
+    for (auto &x : wire8Buff) x = int8_t((std::rand() % 256) - 128);
+
+    std::vector<std::vector<char>> chanBuffs(numChans, std::vector<char>(bufLen*formatBytes(format)));
+    for (auto &buff : chanBuffs) for (auto &x : buff) x = char(std::rand() % 64);
+    void *buffs[2] = {chanBuffs[0].data(), chanBuffs[numChans-1].data()};
+    const bool floats = (format == SOAPY_SDR_CF32);
+    const bool cs8 = (format == SOAPY_SDR_CS8);
+
+    //the same dispatch as the rx and tx conversions of the stream
+    const auto convert = [&](void)
+    {
+        if (not tx and wire8)
+        {
+            const int8_t *in = wire8Buff.data();
+            if (cs8 and numChans == 1) std::memcpy(buffs[0], in, bufLen*2);
+            else if (cs8) deinterleaveCS8(in, (int8_t *)buffs[0], (int8_t *)buffs[1], bufLen);
+            else if (floats and numChans == 1) convertCS8ToCF32(in, (float *)buffs[0], 2*bufLen);
+            else if (floats) deinterleaveCS8ToCF32(in, (float *)buffs[0], (float *)buffs[1], bufLen);
+            else if (numChans == 1) convertCS8ToCS16(in, (int16_t *)buffs[0], 2*bufLen);
+            else deinterleaveCS8ToCS16(in, (int16_t *)buffs[0], (int16_t *)buffs[1], bufLen);
+        }
+        else if (not tx)
+        {
+            const int16_t *in = wire16.data();
+            if (not floats and numChans == 1) std::memcpy(buffs[0], in, bufLen*4);
+            else if (floats and numChans == 1) convertCS16ToCF32(in, (float *)buffs[0], 2*bufLen);
+            else if (not floats) deinterleaveCS16(in, (int16_t *)buffs[0], (int16_t *)buffs[1], bufLen);
+            else deinterleaveCS16ToCF32(in, (float *)buffs[0], (float *)buffs[1], bufLen);
+        }
+        else if (wire8)
+        {
+            int8_t *out = wire8Buff.data();
+            if (cs8 and numChans == 1) std::memcpy(out, buffs[0], bufLen*2);
+            else if (cs8) interleaveCS8((const int8_t *)buffs[0], (const int8_t *)buffs[1], out, bufLen);
+            else if (floats and numChans == 1) convertCF32ToCS8((const float *)buffs[0], out, 2*bufLen);
+            else if (floats) interleaveCF32ToCS8((const float *)buffs[0], (const float *)buffs[1], out, bufLen);
+            else if (numChans == 1) convertCS16ToCS8((const int16_t *)buffs[0], out, 2*bufLen);
+            else interleaveCS16ToCS8((const int16_t *)buffs[0], (const int16_t *)buffs[1], out, bufLen);
+        }
+        else
+        {
+            int16_t *out = wire16.data();
+            if (not floats and numChans == 1) std::memcpy(out, buffs[0], bufLen*4);
+            else if (floats and numChans == 1) convertCF32ToCS16((const float *)buffs[0], out, 2*bufLen);
+            else if (not floats) interleaveCS16((const int16_t *)buffs[0], (const int16_t *)buffs[1], out, bufLen);
+            else interleaveCF32ToCS16((const float *)buffs[0], (const float *)buffs[1], out, bufLen);
+        }
+    };
+
+    BenchResult result;
+    const auto start = std::chrono::steady_clock::now();
+    const auto exitTime = start + std::chrono::microseconds(long(config.seconds*1e6));
+    const std::clock_t cpuStart = std::clock();
+    while (true)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        if (t0 > exitTime) break;
+        convert();
+        const auto t1 = std::chrono::steady_clock::now();
+        result.addLatency(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        result.samples += bufLen;
+    }
+    result.cpuSeconds = double(std::clock() - cpuStart)/CLOCKS_PER_SEC;
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/*******************************************************************
+ * Device mode: readStream() and writeStream()
+ ******************************************************************/
+
+static BenchResult runDevice(
+    SoapySDR::Device *device,
+    const BenchConfig &config,
+    const std::string &format,
+    const std::vector<size_t> &channels,
+    const SoapySDR::Kwargs &streamArgs)
+{
+    SoapySDR::Stream *stream = device->setupStream(config.direction, format, channels, streamArgs);
+    const size_t mtu = device->getStreamMTU(stream);
+    std::vector<std::vector<char>> chanBuffs(channels.size(), std::vector<char>(mtu*formatBytes(format)));
+    std::vector<void *> buffs;
+    for (auto &buff : chanBuffs) buffs.push_back(buff.data());
+
+    BenchResult result;
+    device->activateStream(stream);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto exitTime = start + std::chrono::microseconds(long(config.seconds*1e6));
+    const std::clock_t cpuStart = std::clock();
+    while (true)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        if (t0 > exitTime) break;
+
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = (config.direction == SOAPY_SDR_RX)?
+            device->readStream(stream, buffs.data(), mtu, flags, timeNs):
+            device->writeStream(stream, buffs.data(), mtu, flags, timeNs);
+        const auto t1 = std::chrono::steady_clock::now();
+        result.addLatency(std::chrono::duration<double, std::micro>(t1 - t0).count());
+
+        if (ret > 0) result.samples += ret;
+        else if (ret == SOAPY_SDR_OVERFLOW) result.overflows++;
+        else if (ret != SOAPY_SDR_TIMEOUT) result.errors++;
+
+        //collect underflow reports without waiting
+        if (config.direction == SOAPY_SDR_TX)
+        {
+            size_t chanMask = 0;
+            while (device->readStreamStatus(stream, chanMask, flags, timeNs, 0) == SOAPY_SDR_UNDERFLOW) result.underflows++;
+        }
+    }
+    result.cpuSeconds = double(std::clock() - cpuStart)/CLOCKS_PER_SEC;
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    device->deactivateStream(stream);
+    device->closeStream(stream);
+    return result;
+}
+
+/*******************************************************************
+ * Sweep and report
+ ******************************************************************/
+
+static void printHeader(void)
+{
+    std::printf("%-4s %-5s %-3s %10s %8s %8s %6s %10s %9s %9s %9s %6s %6s %6s\n",
+        "dir", "fmt", "lay", "rate", "buffers", "buflen", "xfers",
+        "MS/s", "cpu ns/S", "p50 us", "p99 us", "ovf", "unf", "err");
+}
+
+static void printResult(const BenchConfig &config, const std::string &format, const std::string &layout,
+    const std::string &rate, const std::string &buffers, const std::string &buflen, const std::string &xfers, BenchResult &result)
+{
+    const double msps = (result.wallSeconds > 0)?(result.samples/result.wallSeconds/1e6):0.0;
+    const double cpuNs = (result.samples > 0)?(result.cpuSeconds*1e9/result.samples):0.0;
+    std::printf("%-4s %-5s %-3s %10s %8s %8s %6s %10.3f %9.2f %9.1f %9.1f %6llu %6llu %6llu\n",
+        (config.direction == SOAPY_SDR_RX)?"rx":"tx", format.c_str(), layout.c_str(),
+        config.mock?"-":rate.c_str(), config.mock?"-":buffers.c_str(), buflen.c_str(), config.mock?"-":xfers.c_str(),
+        msps, cpuNs, percentile(result.latencyUs, 0.50), percentile(result.latencyUs, 0.99),
+        result.overflows, result.underflows, result.errors);
+    std::fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const bool hasValue = (i+1 < argc);
+        if (arg == "--help" or arg == "-h") {printUsage(); return EXIT_SUCCESS;}
+        else if (arg == "--mock") config.mock = true;
+        else if (arg == "--tx") config.direction = SOAPY_SDR_TX;
+        else if (arg == "--args" and hasValue) config.deviceArgs = argv[++i];
+        else if (arg == "--time" and hasValue) config.seconds = std::atof(argv[++i]);
+        else if (arg == "--rates" and hasValue) config.rates = splitList(argv[++i]);
+        else if (arg == "--buffers" and hasValue) config.buffers = splitList(argv[++i]);
+        else if (arg == "--buflen" and hasValue) config.buflens = splitList(argv[++i]);
+        else if (arg == "--transfers" and hasValue) config.transfers = splitList(argv[++i]);
+        else if (arg == "--formats" and hasValue) config.formats = splitList(argv[++i]);
+        else if (arg == "--layouts" and hasValue) config.layouts = splitList(argv[++i]);
+        else if (arg == "--wire" and hasValue) config.wire = argv[++i];
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (config.mock)
+    {
+        std::cout << "Mock mode, conversion kernels: " << convertKernelName() << std::endl;
+        printHeader();
+        for (const auto &format : config.formats)
+        for (const auto &layout : config.layouts)
+        for (const auto &buflen : config.buflens)
+        {
+            BenchResult result = runMock(config, format, (layout == "X2")?2:1, size_t(std::atol(buflen.c_str())));
+            printResult(config, format, layout, "", "", buflen, "", result);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    SoapySDR::Device *device = nullptr;
+    try
+    {
+        device = SoapySDR::Device::make(config.deviceArgs);
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Failed to make device: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    printHeader();
+    int status = EXIT_SUCCESS;
+    for (const auto &rate : config.rates)
+    for (const auto &layout : config.layouts)
+    {
+        const std::vector<size_t> channels = (layout == "X2")?std::vector<size_t>{0, 1}:std::vector<size_t>{0};
+        if (channels.size() > device->getNumChannels(config.direction)) continue;
+        for (const auto ch : channels) device->setSampleRate(config.direction, ch, std::atof(rate.c_str()));
+
+        for (const auto &format : config.formats)
+        for (const auto &buffers : config.buffers)
+        for (const auto &buflen : config.buflens)
+        for (const auto &xfers : config.transfers)
+        {
+            SoapySDR::Kwargs streamArgs;
+            streamArgs["buffers"] = buffers;
+            streamArgs["buflen"] = buflen;
+            streamArgs["transfers"] = xfers;
+            streamArgs["wire"] = config.wire;
+            try
+            {
+                BenchResult result = runDevice(device, config, format, channels, streamArgs);
+                printResult(config, format, layout, rate, buffers, buflen, xfers, result);
+            }
+            catch (const std::exception &ex)
+            {
+                std::cerr << format << " " << layout << " failed: " << ex.what() << std::endl;
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    SoapySDR::Device::unmake(device);
+    return status;
+}
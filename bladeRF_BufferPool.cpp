@@ -0,0 +1,196 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bladeRF_BufferPool.hpp"
+#include <SoapySDR/Logger.hpp>
+#include <stdexcept>
+#include <algorithm> //max
+#include <cstring> //strerror
+#include <cerrno>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+//memory policy mode from linux/mempolicy.h, see ThreadPolicy
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+//! Released buffers kept around for reuse, beyond this the smallest are freed
+#define MAX_FREE_BLOCKS 8
+
+//! Huge page size used to round up huge page allocations
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+static size_t pageSize(void)
+{
+    #ifdef _WIN32
+    return 4096;
+    #else
+    static const size_t size = size_t(sysconf(_SC_PAGESIZE));
+    return size;
+    #endif
+}
+
+static size_t roundUp(const size_t numBytes, const size_t multiple)
+{
+    return ((numBytes + multiple - 1) / multiple) * multiple;
+}
+
+BufferPool::BufferPool(void)
+{
+    return;
+}
+
+BufferPool::~BufferPool(void)
+{
+    for (const auto &block : _blocks) deallocate(block);
+}
+
+void *BufferPool::acquire(const size_t numBytes, const bool locked, const bool hugePages, const int numaNode)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    //best fit among the released buffers with the same options
+    Block *best = nullptr;
+    for (auto &block : _blocks)
+    {
+        if (block.inUse or block.numBytes < numBytes) continue;
+        if (block.locked != locked or block.hugePages != hugePages or block.numaNode != numaNode) continue;
+        if (best == nullptr or block.numBytes < best->numBytes) best = &block;
+    }
+
+    if (best == nullptr)
+    {
+        _blocks.push_back(allocate(numBytes, locked, hugePages, numaNode));
+        best = &_blocks.back();
+    }
+
+    best->inUse = true;
+    return best->buff;
+}
+
+void BufferPool::release(void *buff)
+{
+    if (buff == nullptr) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    size_t numFree = 0;
+    for (auto &block : _blocks)
+    {
+        if (block.buff == buff) block.inUse = false;
+        if (not block.inUse) numFree++;
+    }
+
+    //bound the memory held by the pool, drop the smallest free buffers first
+    while (numFree > MAX_FREE_BLOCKS)
+    {
+        auto smallest = _blocks.end();
+        for (auto it = _blocks.begin(); it != _blocks.end(); ++it)
+        {
+            if (it->inUse) continue;
+            if (smallest == _blocks.end() or it->numBytes < smallest->numBytes) smallest = it;
+        }
+        deallocate(*smallest);
+        _blocks.erase(smallest);
+        numFree--;
+    }
+}
+
+BufferPool::Block BufferPool::allocate(const size_t numBytes, const bool locked, const bool hugePages, const int numaNode)
+{
+    Block block;
+    block.buff = nullptr;
+    block.numBytes = roundUp(std::max<size_t>(numBytes, 1), pageSize());
+    block.locked = locked;
+    block.hugePages = hugePages;
+    block.numaNode = numaNode;
+    block.inUse = false;
+
+    #ifdef _WIN32
+    block.buff = _aligned_malloc(block.numBytes, pageSize());
+    if (block.buff == nullptr) throw std::runtime_error("BufferPool::acquire() allocation failed");
+    if (locked or hugePages) SoapySDR::logf(SOAPY_SDR_WARNING, "BufferPool locked and huge page buffers are not supported on this platform");
+    #else
+
+    //explicit huge pages need a reserved pool, fall back to transparent huge pages
+    #ifdef MAP_HUGETLB
+    if (hugePages)
+    {
+        const size_t hugeBytes = roundUp(block.numBytes, HUGE_PAGE_SIZE);
+        void *buff = mmap(nullptr, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buff != MAP_FAILED)
+        {
+            block.buff = buff;
+            block.numBytes = hugeBytes;
+        }
+    }
+    #endif
+
+    if (block.buff == nullptr)
+    {
+        void *buff = mmap(nullptr, block.numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buff == MAP_FAILED) throw std::runtime_error("BufferPool::acquire() mmap failed " + std::string(strerror(errno)));
+        block.buff = buff;
+        #ifdef MADV_HUGEPAGE
+        if (hugePages) madvise(buff, block.numBytes, MADV_HUGEPAGE);
+        #endif
+    }
+
+    //the policy must be set before the pages are faulted in by mlock() or the first access
+    #ifdef __linux__
+    if (numaNode >= 0 and numaNode < int(8*sizeof(unsigned long)))
+    {
+        const unsigned long mask = 1UL << numaNode;
+        if (syscall(SYS_mbind, block.buff, block.numBytes, MPOL_PREFERRED, &mask, 8*sizeof(mask)+1, 0) != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "BufferPool mbind(node %d) failed: %s", numaNode, strerror(errno));
+        }
+    }
+    #endif
+
+    //locking can fail on RLIMIT_MEMLOCK, the buffer is still usable
+    if (locked and mlock(block.buff, block.numBytes) != 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_WARNING, "BufferPool mlock(%d bytes) failed: %s", int(block.numBytes), strerror(errno));
+    }
+    #endif
+
+    return block;
+}
+
+void BufferPool::deallocate(const Block &block)
+{
+    #ifdef _WIN32
+    _aligned_free(block.buff);
+    #else
+    if (block.locked) munlock(block.buff, block.numBytes);
+    munmap(block.buff, block.numBytes);
+    #endif
+}
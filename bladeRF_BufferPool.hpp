@@ -0,0 +1,71 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/*!
+ * A pool of page-aligned sample buffers that outlive setupStream()/closeStream().
+ * Released buffers are kept and handed out again to a later request of the
+ * same or smaller size with the same options, so stream re-creation does not
+ * allocate. Buffers may be locked into memory, backed by huge pages,
+ * and placed on a NUMA node.
+ */
+class BufferPool
+{
+public:
+
+    BufferPool(void);
+
+    //! Frees every buffer, acquired buffers must not be used afterwards
+    ~BufferPool(void);
+
+    /*!
+     * Get a buffer of at least numBytes that is aligned to a page.
+     * \param locked lock the pages into memory with mlock()
+     * \param hugePages try to back the buffer with huge pages
+     * \param numaNode prefer the pages of this NUMA node, -1 for any node
+     */
+    void *acquire(const size_t numBytes, const bool locked = false, const bool hugePages = false, const int numaNode = -1);
+
+    //! Return a buffer from acquire() to the pool, NULL is ignored
+    void release(void *buff);
+
+private:
+    struct Block
+    {
+        void *buff;
+        size_t numBytes;
+        bool locked;
+        bool hugePages;
+        int numaNode;
+        bool inUse;
+    };
+
+    static Block allocate(const size_t numBytes, const bool locked, const bool hugePages, const int numaNode);
+    static void deallocate(const Block &block);
+
+    std::mutex _mutex;
+    std::vector<Block> _blocks;
+};
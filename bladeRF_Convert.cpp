@@ -0,0 +1,632 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bladeRF_Convert.hpp"
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__)) and defined(__SSE2__)
+#define BLADERF_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) or defined(__ARM_NEON__)
+#define BLADERF_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+/*******************************************************************
+ * Generic kernels, also used for the tail of the vector kernels
+ ******************************************************************/
+
+static void cs16ToCf32Scalar(const int16_t *in, float *out, const size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = float(in[i])/2048;
+    }
+}
+
+static void cf32ToCs16Scalar(const float *in, int16_t *out, const size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = floatToQ11(in[i]);
+    }
+}
+
+static void deinterleaveCS16Scalar(const int16_t *in, int16_t *out0, int16_t *out1, const size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        *(out0++) = *(in++);
+        *(out0++) = *(in++);
+        *(out1++) = *(in++);
+        *(out1++) = *(in++);
+    }
+}
+
+static void deinterleaveCS16ToCF32Scalar(const int16_t *in, float *out0, float *out1, const size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        *(out0++) = float(*(in++))/2048;
+        *(out0++) = float(*(in++))/2048;
+        *(out1++) = float(*(in++))/2048;
+        *(out1++) = float(*(in++))/2048;
+    }
+}
+
+static void interleaveCS16Scalar(const int16_t *in0, const int16_t *in1, int16_t *out, const size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        *(out++) = *(in0++);
+        *(out++) = *(in0++);
+        *(out++) = *(in1++);
+        *(out++) = *(in1++);
+    }
+}
+
+static void interleaveCF32ToCS16Scalar(const float *in0, const float *in1, int16_t *out, const size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        *(out++) = floatToQ11(*(in0++));
+        *(out++) = floatToQ11(*(in0++));
+        *(out++) = floatToQ11(*(in1++));
+        *(out++) = floatToQ11(*(in1++));
+    }
+}
+
+/*******************************************************************
+ * Generic 8-bit kernels, the compiler vectorizes the simple loops
+ ******************************************************************/
+
+struct Q7ToFloat { float operator()(const int8_t x) const {return float(x)/128;} };
+struct FloatToQ7 { int8_t operator()(const float x) const {return floatToQ7(x);} };
+struct Q7ToQ11 { int16_t operator()(const int8_t x) const {return int16_t(x*16);} };
+struct Q11ToQ7 { int8_t operator()(const int16_t x) const {return q11ToQ7(x);} };
+struct Identity { template <typename T> T operator()(const T x) const {return x;} };
+
+template <typename InType, typename OutType, typename Fcn>
+static void convertScalar(const InType *in, OutType *out, const size_t n, const Fcn &f)
+{
+    for (size_t i = 0; i < n; i++) out[i] = f(in[i]);
+}
+
+template <typename InType, typename OutType, typename Fcn>
+static void deinterleaveScalar(const InType *in, OutType *out0, OutType *out1, const size_t n, const Fcn &f)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        *(out0++) = f(*(in++));
+        *(out0++) = f(*(in++));
+        *(out1++) = f(*(in++));
+        *(out1++) = f(*(in++));
+    }
+}
+
+template <typename InType, typename OutType, typename Fcn>
+static void interleaveScalar(const InType *in0, const InType *in1, OutType *out, const size_t n, const Fcn &f)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        *(out++) = f(*(in0++));
+        *(out++) = f(*(in0++));
+        *(out++) = f(*(in1++));
+        *(out++) = f(*(in1++));
+    }
+}
+
+static void cs8ToCf32Scalar(const int8_t *in, float *out, const size_t n)
+{
+    convertScalar(in, out, n, Q7ToFloat());
+}
+
+static void cf32ToCs8Scalar(const float *in, int8_t *out, const size_t n)
+{
+    convertScalar(in, out, n, FloatToQ7());
+}
+
+/*******************************************************************
+ * SSE2 and AVX2 kernels
+ ******************************************************************/
+#ifdef BLADERF_CONVERT_X86
+
+static void cs16ToCf32SSE2(const int16_t *in, float *out, const size_t n)
+{
+    const __m128 scale = _mm_set1_ps(1.0f/2048);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in+i));
+        //sign extend by unpacking into the upper half and shifting down
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out+i+0, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out+i+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    cs16ToCf32Scalar(in+i, out+i, n-i);
+}
+
+static void cf32ToCs16SSE2(const float *in, int16_t *out, const size_t n)
+{
+    const __m128 scale = _mm_set1_ps(2048);
+    const __m128 maxVal = _mm_set1_ps(2047);
+    const __m128 minVal = _mm_set1_ps(-2048);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in+i+0), scale), maxVal), minVal);
+        const __m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in+i+4), scale), maxVal), minVal);
+        const __m128i x = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+i), x);
+    }
+    cf32ToCs16Scalar(in+i, out+i, n-i);
+}
+
+//! Gather the even 32-bit samples into the low half and the odd into the high half
+static inline __m128i deinterleaveSSE2(const __m128i x)
+{
+    return _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static void deinterleaveCS16SSE2(const int16_t *in, int16_t *out0, int16_t *out1, const size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i a = deinterleaveSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in+4*i+0)));
+        const __m128i b = deinterleaveSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in+4*i+8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out0+2*i), _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out1+2*i), _mm_unpackhi_epi64(a, b));
+    }
+    deinterleaveCS16Scalar(in+4*i, out0+2*i, out1+2*i, n-i);
+}
+
+static void deinterleaveCS16ToCF32SSE2(const int16_t *in, float *out0, float *out1, const size_t n)
+{
+    const __m128 scale = _mm_set1_ps(1.0f/2048);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        //8 scalars hold 2 samples per channel: ch0 in the low half, ch1 in the high half
+        const __m128i x = deinterleaveSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in+4*i)));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out0+2*i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out1+2*i, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    deinterleaveCS16ToCF32Scalar(in+4*i, out0+2*i, out1+2*i, n-i);
+}
+
+static void interleaveCS16SSE2(const int16_t *in0, const int16_t *in1, int16_t *out, const size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in0+2*i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in1+2*i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+4*i+0), _mm_unpacklo_epi32(a, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+4*i+8), _mm_unpackhi_epi32(a, b));
+    }
+    interleaveCS16Scalar(in0+2*i, in1+2*i, out+4*i, n-i);
+}
+
+static void interleaveCF32ToCS16SSE2(const float *in0, const float *in1, int16_t *out, const size_t n)
+{
+    const __m128 scale = _mm_set1_ps(2048);
+    const __m128 maxVal = _mm_set1_ps(2047);
+    const __m128 minVal = _mm_set1_ps(-2048);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in0+2*i), scale), maxVal), minVal);
+        const __m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in1+2*i), scale), maxVal), minVal);
+        //pack puts ch0 in the low half and ch1 in the high half, then alternate the samples
+        const __m128i x = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+4*i), _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    interleaveCF32ToCS16Scalar(in0+2*i, in1+2*i, out+4*i, n-i);
+}
+
+static void cs8ToCf32SSE2(const int8_t *in, float *out, const size_t n)
+{
+    const __m128 scale = _mm_set1_ps(1.0f/128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        //sign extend 8 to 16 to 32 bits by unpacking into the upper bits and shifting down
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in+i));
+        const __m128i lo16 = _mm_unpacklo_epi8(x, x);
+        const __m128i hi16 = _mm_unpackhi_epi8(x, x);
+        const __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 24);
+        const __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 24);
+        const __m128i c = _mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 24);
+        const __m128i d = _mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 24);
+        _mm_storeu_ps(out+i+0, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(out+i+4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+        _mm_storeu_ps(out+i+8, _mm_mul_ps(_mm_cvtepi32_ps(c), scale));
+        _mm_storeu_ps(out+i+12, _mm_mul_ps(_mm_cvtepi32_ps(d), scale));
+    }
+    cs8ToCf32Scalar(in+i, out+i, n-i);
+}
+
+static void cf32ToCs8SSE2(const float *in, int8_t *out, const size_t n)
+{
+    const __m128 scale = _mm_set1_ps(128);
+    const __m128 maxVal = _mm_set1_ps(127);
+    const __m128 minVal = _mm_set1_ps(-128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i x[4];
+        for (size_t j = 0; j < 4; j++)
+        {
+            const __m128 f = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in+i+4*j), scale), maxVal), minVal);
+            x[j] = _mm_cvttps_epi32(f);
+        }
+        const __m128i y = _mm_packs_epi16(_mm_packs_epi32(x[0], x[1]), _mm_packs_epi32(x[2], x[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out+i), y);
+    }
+    cf32ToCs8Scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void cs16ToCf32AVX2(const int16_t *in, float *out, const size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f/2048);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in+i+0));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in+i+8));
+        _mm256_storeu_ps(out+i+0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), scale));
+        _mm256_storeu_ps(out+i+8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), scale));
+    }
+    cs16ToCf32Scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void cf32ToCs16AVX2(const float *in, int16_t *out, const size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(2048);
+    const __m256 maxVal = _mm256_set1_ps(2047);
+    const __m256 minVal = _mm256_set1_ps(-2048);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m256 a = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in+i+0), scale), maxVal), minVal);
+        const __m256 b = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in+i+8), scale), maxVal), minVal);
+        //packs works per 128-bit lane, permute the 64-bit quarters back in order
+        const __m256i x = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out+i), _mm256_permute4x64_epi64(x, 0xd8));
+    }
+    cf32ToCs16Scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void deinterleaveCS16ToCF32AVX2(const int16_t *in, float *out0, float *out1, const size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f/2048);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        //shuffle each lane to even/odd pairs, then gather ch0 in the low lane and ch1 in the high lane
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in+4*i));
+        const __m256i y = _mm256_permute4x64_epi64(_mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0)), 0xd8);
+        const __m256i ch0 = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(y));
+        const __m256i ch1 = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(y, 1));
+        _mm256_storeu_ps(out0+2*i, _mm256_mul_ps(_mm256_cvtepi32_ps(ch0), scale));
+        _mm256_storeu_ps(out1+2*i, _mm256_mul_ps(_mm256_cvtepi32_ps(ch1), scale));
+    }
+    deinterleaveCS16ToCF32Scalar(in+4*i, out0+2*i, out1+2*i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void interleaveCF32ToCS16AVX2(const float *in0, const float *in1, int16_t *out, const size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(2048);
+    const __m256 maxVal = _mm256_set1_ps(2047);
+    const __m256 minVal = _mm256_set1_ps(-2048);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256 a = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in0+2*i), scale), maxVal), minVal);
+        const __m256 b = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in1+2*i), scale), maxVal), minVal);
+        //per lane packs gives 2 samples of ch0 followed by 2 of ch1, alternate them in each lane
+        const __m256i x = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out+4*i), _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    interleaveCF32ToCS16Scalar(in0+2*i, in1+2*i, out+4*i, n-i);
+}
+
+#endif //BLADERF_CONVERT_X86
+
+/*******************************************************************
+ * NEON kernels
+ ******************************************************************/
+#ifdef BLADERF_CONVERT_NEON
+
+static void cs16ToCf32NEON(const int16_t *in, float *out, const size_t n)
+{
+    const float32x4_t scale = vdupq_n_f32(1.0f/2048);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const int16x8_t x = vld1q_s16(in+i);
+        vst1q_f32(out+i+0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), scale));
+        vst1q_f32(out+i+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), scale));
+    }
+    cs16ToCf32Scalar(in+i, out+i, n-i);
+}
+
+static void cf32ToCs16NEON(const float *in, int16_t *out, const size_t n)
+{
+    const float32x4_t scale = vdupq_n_f32(2048);
+    const float32x4_t maxVal = vdupq_n_f32(2047);
+    const float32x4_t minVal = vdupq_n_f32(-2048);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const float32x4_t a = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in+i+0), scale), maxVal), minVal);
+        const float32x4_t b = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in+i+4), scale), maxVal), minVal);
+        vst1q_s16(out+i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+    }
+    cf32ToCs16Scalar(in+i, out+i, n-i);
+}
+
+static void cs8ToCf32NEON(const int8_t *in, float *out, const size_t n)
+{
+    const float32x4_t scale = vdupq_n_f32(1.0f/128);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const int16x8_t x = vmovl_s8(vld1_s8(in+i));
+        vst1q_f32(out+i+0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), scale));
+        vst1q_f32(out+i+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), scale));
+    }
+    cs8ToCf32Scalar(in+i, out+i, n-i);
+}
+
+static void cf32ToCs8NEON(const float *in, int8_t *out, const size_t n)
+{
+    const float32x4_t scale = vdupq_n_f32(128);
+    const float32x4_t maxVal = vdupq_n_f32(127);
+    const float32x4_t minVal = vdupq_n_f32(-128);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const float32x4_t a = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in+i+0), scale), maxVal), minVal);
+        const float32x4_t b = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in+i+4), scale), maxVal), minVal);
+        const int16x8_t x = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b)));
+        vst1_s8(out+i, vqmovn_s16(x));
+    }
+    cf32ToCs8Scalar(in+i, out+i, n-i);
+}
+
+static void deinterleaveCS16NEON(const int16_t *in, int16_t *out0, int16_t *out1, const size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        //each complex sample is one 32-bit lane, vld2 splits the even and odd lanes
+        const int32x4x2_t x = vld2q_s32(reinterpret_cast<const int32_t *>(in+4*i));
+        vst1q_s32(reinterpret_cast<int32_t *>(out0+2*i), x.val[0]);
+        vst1q_s32(reinterpret_cast<int32_t *>(out1+2*i), x.val[1]);
+    }
+    deinterleaveCS16Scalar(in+4*i, out0+2*i, out1+2*i, n-i);
+}
+
+static void deinterleaveCS16ToCF32NEON(const int16_t *in, float *out0, float *out1, const size_t n)
+{
+    const float32x4_t scale = vdupq_n_f32(1.0f/2048);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const int32x4x2_t x = vld2q_s32(reinterpret_cast<const int32_t *>(in+4*i));
+        const int16x8_t a = vreinterpretq_s16_s32(x.val[0]);
+        const int16x8_t b = vreinterpretq_s16_s32(x.val[1]);
+        vst1q_f32(out0+2*i+0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(a))), scale));
+        vst1q_f32(out0+2*i+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(a))), scale));
+        vst1q_f32(out1+2*i+0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(b))), scale));
+        vst1q_f32(out1+2*i+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(b))), scale));
+    }
+    deinterleaveCS16ToCF32Scalar(in+4*i, out0+2*i, out1+2*i, n-i);
+}
+
+static void interleaveCS16NEON(const int16_t *in0, const int16_t *in1, int16_t *out, const size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        int32x4x2_t x;
+        x.val[0] = vld1q_s32(reinterpret_cast<const int32_t *>(in0+2*i));
+        x.val[1] = vld1q_s32(reinterpret_cast<const int32_t *>(in1+2*i));
+        vst2q_s32(reinterpret_cast<int32_t *>(out+4*i), x);
+    }
+    interleaveCS16Scalar(in0+2*i, in1+2*i, out+4*i, n-i);
+}
+
+static void interleaveCF32ToCS16NEON(const float *in0, const float *in1, int16_t *out, const size_t n)
+{
+    const float32x4_t scale = vdupq_n_f32(2048);
+    const float32x4_t maxVal = vdupq_n_f32(2047);
+    const float32x4_t minVal = vdupq_n_f32(-2048);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        int16x8_t ch[2];
+        const float *in[2] = {in0+2*i, in1+2*i};
+        for (size_t c = 0; c < 2; c++)
+        {
+            const float32x4_t a = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in[c]+0), scale), maxVal), minVal);
+            const float32x4_t b = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in[c]+4), scale), maxVal), minVal);
+            ch[c] = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b)));
+        }
+        int32x4x2_t x;
+        x.val[0] = vreinterpretq_s32_s16(ch[0]);
+        x.val[1] = vreinterpretq_s32_s16(ch[1]);
+        vst2q_s32(reinterpret_cast<int32_t *>(out+4*i), x);
+    }
+    interleaveCF32ToCS16Scalar(in0+2*i, in1+2*i, out+4*i, n-i);
+}
+
+#endif //BLADERF_CONVERT_NEON
+
+/*******************************************************************
+ * Runtime kernel selection
+ ******************************************************************/
+
+struct ConvertKernels
+{
+    const char *name;
+    void (*cs16ToCf32)(const int16_t *, float *, const size_t);
+    void (*cf32ToCs16)(const float *, int16_t *, const size_t);
+    void (*deinterleaveCs16)(const int16_t *, int16_t *, int16_t *, const size_t);
+    void (*deinterleaveCs16ToCf32)(const int16_t *, float *, float *, const size_t);
+    void (*interleaveCs16)(const int16_t *, const int16_t *, int16_t *, const size_t);
+    void (*interleaveCf32ToCs16)(const float *, const float *, int16_t *, const size_t);
+    void (*cs8ToCf32)(const int8_t *, float *, const size_t);
+    void (*cf32ToCs8)(const float *, int8_t *, const size_t);
+};
+
+static ConvertKernels selectKernels(void)
+{
+    #ifdef BLADERF_CONVERT_X86
+    __builtin_cpu_init();
+    //the plain int16 shuffles are memory bound, sse2 is as good as avx2 there
+    if (__builtin_cpu_supports("avx2")) return {"avx2",
+        &cs16ToCf32AVX2, &cf32ToCs16AVX2,
+        &deinterleaveCS16SSE2, &deinterleaveCS16ToCF32AVX2,
+        &interleaveCS16SSE2, &interleaveCF32ToCS16AVX2,
+        &cs8ToCf32SSE2, &cf32ToCs8SSE2};
+    return {"sse2",
+        &cs16ToCf32SSE2, &cf32ToCs16SSE2,
+        &deinterleaveCS16SSE2, &deinterleaveCS16ToCF32SSE2,
+        &interleaveCS16SSE2, &interleaveCF32ToCS16SSE2,
+        &cs8ToCf32SSE2, &cf32ToCs8SSE2};
+    #endif
+
+    #ifdef BLADERF_CONVERT_NEON
+    return {"neon",
+        &cs16ToCf32NEON, &cf32ToCs16NEON,
+        &deinterleaveCS16NEON, &deinterleaveCS16ToCF32NEON,
+        &interleaveCS16NEON, &interleaveCF32ToCS16NEON,
+        &cs8ToCf32NEON, &cf32ToCs8NEON};
+    #endif
+
+    return {"scalar",
+        &cs16ToCf32Scalar, &cf32ToCs16Scalar,
+        &deinterleaveCS16Scalar, &deinterleaveCS16ToCF32Scalar,
+        &interleaveCS16Scalar, &interleaveCF32ToCS16Scalar,
+        &cs8ToCf32Scalar, &cf32ToCs8Scalar};
+}
+
+static const ConvertKernels &kernels(void)
+{
+    static const ConvertKernels k = selectKernels();
+    return k;
+}
+
+void convertCS16ToCF32(const int16_t *in, float *out, const size_t numScalars)
+{
+    kernels().cs16ToCf32(in, out, numScalars);
+}
+
+void convertCF32ToCS16(const float *in, int16_t *out, const size_t numScalars)
+{
+    kernels().cf32ToCs16(in, out, numScalars);
+}
+
+void deinterleaveCS16(const int16_t *in, int16_t *out0, int16_t *out1, const size_t numSamples)
+{
+    kernels().deinterleaveCs16(in, out0, out1, numSamples);
+}
+
+void deinterleaveCS16ToCF32(const int16_t *in, float *out0, float *out1, const size_t numSamples)
+{
+    kernels().deinterleaveCs16ToCf32(in, out0, out1, numSamples);
+}
+
+void interleaveCS16(const int16_t *in0, const int16_t *in1, int16_t *out, const size_t numSamples)
+{
+    kernels().interleaveCs16(in0, in1, out, numSamples);
+}
+
+void interleaveCF32ToCS16(const float *in0, const float *in1, int16_t *out, const size_t numSamples)
+{
+    kernels().interleaveCf32ToCs16(in0, in1, out, numSamples);
+}
+
+void convertCS8ToCF32(const int8_t *in, float *out, const size_t numScalars)
+{
+    kernels().cs8ToCf32(in, out, numScalars);
+}
+
+void convertCF32ToCS8(const float *in, int8_t *out, const size_t numScalars)
+{
+    kernels().cf32ToCs8(in, out, numScalars);
+}
+
+void convertCS8ToCS16(const int8_t *in, int16_t *out, const size_t numScalars)
+{
+    convertScalar(in, out, numScalars, Q7ToQ11());
+}
+
+void convertCS16ToCS8(const int16_t *in, int8_t *out, const size_t numScalars)
+{
+    convertScalar(in, out, numScalars, Q11ToQ7());
+}
+
+void deinterleaveCS8(const int8_t *in, int8_t *out0, int8_t *out1, const size_t numSamples)
+{
+    deinterleaveScalar(in, out0, out1, numSamples, Identity());
+}
+
+void deinterleaveCS8ToCF32(const int8_t *in, float *out0, float *out1, const size_t numSamples)
+{
+    deinterleaveScalar(in, out0, out1, numSamples, Q7ToFloat());
+}
+
+void deinterleaveCS8ToCS16(const int8_t *in, int16_t *out0, int16_t *out1, const size_t numSamples)
+{
+    deinterleaveScalar(in, out0, out1, numSamples, Q7ToQ11());
+}
+
+void interleaveCS8(const int8_t *in0, const int8_t *in1, int8_t *out, const size_t numSamples)
+{
+    interleaveScalar(in0, in1, out, numSamples, Identity());
+}
+
+void interleaveCF32ToCS8(const float *in0, const float *in1, int8_t *out, const size_t numSamples)
+{
+    interleaveScalar(in0, in1, out, numSamples, FloatToQ7());
+}
+
+void interleaveCS16ToCS8(const int16_t *in0, const int16_t *in1, int8_t *out, const size_t numSamples)
+{
+    interleaveScalar(in0, in1, out, numSamples, Q11ToQ7());
+}
+
+std::string convertKernelName(void)
+{
+    return kernels().name;
+}
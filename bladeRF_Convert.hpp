@@ -0,0 +1,115 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*!
+ * Sample conversions between the bladeRF wire format and the stream formats.
+ * SC16_Q11 samples have a full scale of 2048 and a valid range of [-2048, 2047].
+ * SC8_Q7 samples have a full scale of 128 and a valid range of [-128, 127].
+ * CS16 buffers carried over an SC8_Q7 wire keep the Q11 scale (a factor of 16).
+ * Each kernel is selected once at runtime from the available CPU features.
+ * The count arguments are in scalars (2 per complex sample), not samples,
+ * except for the dual channel kernels which count samples per channel.
+ * Dual channel (X2) buffers alternate one complex sample per channel.
+ */
+
+//! Convert a single float to Q11, saturating instead of wrapping
+static inline int16_t floatToQ11(const float in)
+{
+    const float x = in*2048;
+    if (x >= 2047) return 2047;
+    if (x <= -2048) return -2048;
+    return int16_t(x);
+}
+
+//! Convert a single float to Q7, saturating instead of wrapping
+static inline int8_t floatToQ7(const float in)
+{
+    const float x = in*128;
+    if (x >= 127) return 127;
+    if (x <= -128) return -128;
+    return int8_t(x);
+}
+
+//! Convert a single Q11 int16 to Q7, saturating instead of wrapping
+static inline int8_t q11ToQ7(const int16_t in)
+{
+    const int x = in >> 4;
+    if (x >= 127) return 127;
+    if (x <= -128) return -128;
+    return int8_t(x);
+}
+
+//! Q11 int16 to float scaled to +/-1.0
+void convertCS16ToCF32(const int16_t *in, float *out, const size_t numScalars);
+
+//! Float scaled to +/-1.0 to Q11 int16 with saturation
+void convertCF32ToCS16(const float *in, int16_t *out, const size_t numScalars);
+
+//! Split an X2 buffer into two Q11 int16 channel buffers
+void deinterleaveCS16(const int16_t *in, int16_t *out0, int16_t *out1, const size_t numSamples);
+
+//! Split an X2 buffer into two float channel buffers
+void deinterleaveCS16ToCF32(const int16_t *in, float *out0, float *out1, const size_t numSamples);
+
+//! Merge two Q11 int16 channel buffers into an X2 buffer
+void interleaveCS16(const int16_t *in0, const int16_t *in1, int16_t *out, const size_t numSamples);
+
+//! Merge two float channel buffers into an X2 buffer with saturation
+void interleaveCF32ToCS16(const float *in0, const float *in1, int16_t *out, const size_t numSamples);
+
+//! Q7 int8 to float scaled to +/-1.0
+void convertCS8ToCF32(const int8_t *in, float *out, const size_t numScalars);
+
+//! Float scaled to +/-1.0 to Q7 int8 with saturation
+void convertCF32ToCS8(const float *in, int8_t *out, const size_t numScalars);
+
+//! Q7 int8 to Q11 int16
+void convertCS8ToCS16(const int8_t *in, int16_t *out, const size_t numScalars);
+
+//! Q11 int16 to Q7 int8 with saturation
+void convertCS16ToCS8(const int16_t *in, int8_t *out, const size_t numScalars);
+
+//! Split an 8-bit X2 buffer into two Q7 int8 channel buffers
+void deinterleaveCS8(const int8_t *in, int8_t *out0, int8_t *out1, const size_t numSamples);
+
+//! Split an 8-bit X2 buffer into two float channel buffers
+void deinterleaveCS8ToCF32(const int8_t *in, float *out0, float *out1, const size_t numSamples);
+
+//! Split an 8-bit X2 buffer into two Q11 int16 channel buffers
+void deinterleaveCS8ToCS16(const int8_t *in, int16_t *out0, int16_t *out1, const size_t numSamples);
+
+//! Merge two Q7 int8 channel buffers into an 8-bit X2 buffer
+void interleaveCS8(const int8_t *in0, const int8_t *in1, int8_t *out, const size_t numSamples);
+
+//! Merge two float channel buffers into an 8-bit X2 buffer with saturation
+void interleaveCF32ToCS8(const float *in0, const float *in1, int8_t *out, const size_t numSamples);
+
+//! Merge two Q11 int16 channel buffers into an 8-bit X2 buffer with saturation
+void interleaveCS16ToCS8(const int16_t *in0, const int16_t *in1, int8_t *out, const size_t numSamples);
+
+//! Name of the kernel set picked for this CPU (scalar, sse2, avx2, neon)
+std::string convertKernelName(void);
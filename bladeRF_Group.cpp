@@ -0,0 +1,260 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bladeRF_SoapySDR.hpp"
+#include <SoapySDR/Logger.hpp>
+#include <stdexcept>
+#include <algorithm> //find
+#include <cstring> //memset
+#include <thread>
+#include <chrono>
+#include <map>
+
+//the gated capture that measures the trigger edge
+#define GROUP_SYNC_NUM_BUFFS 8
+#define GROUP_SYNC_BUFF_LEN 1024
+#define GROUP_SYNC_NUM_XFERS 4
+#define GROUP_SYNC_TIMEOUT_MS 2000
+#define GROUP_ARM_SETTLE_MS 100 //lets every member block on the gate before firing
+#define GROUP_START_LEAD_NS 100000000 //activateGroupStreams() default start after now
+
+/*******************************************************************
+ * Group registry
+ ******************************************************************/
+
+//groups are process local, the registry lock also keeps members alive during group calls
+static std::mutex &groupMutex(void)
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::map<std::string, std::vector<bladeRF_SoapySDR *>> &groupRegistry(void)
+{
+    static std::map<std::string, std::vector<bladeRF_SoapySDR *>> groups;
+    return groups;
+}
+
+std::vector<bladeRF_SoapySDR *> bladeRF_SoapySDR::groupMembers(void) const
+{
+    if (_groupName.empty()) throw std::runtime_error("bladeRF device is not in a group");
+    return groupRegistry().at(_groupName);
+}
+
+void bladeRF_SoapySDR::joinGroup(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    auto &groups = groupRegistry();
+
+    if (not _groupName.empty())
+    {
+        auto &members = groups[_groupName];
+        members.erase(std::find(members.begin(), members.end(), this));
+        if (members.empty()) groups.erase(_groupName);
+    }
+
+    _groupName = name;
+    if (not name.empty())
+    {
+        groups[name].push_back(this);
+        SoapySDR::logf(SOAPY_SDR_INFO, "bladeRF joined group '%s' with %d members", name.c_str(), int(groups[name].size()));
+    }
+}
+
+/*******************************************************************
+ * Shared clock and timebase
+ ******************************************************************/
+
+void bladeRF_SoapySDR::setGroupClockSource(const std::string &source)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    for (auto member : this->groupMembers()) member->setClockSource(source);
+}
+
+void bladeRF_SoapySDR::syncGroupTime(const long long timeNs)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    const auto members = this->groupMembers();
+
+    //the alignment is in ticks, so one rate maps the edge to the same time everywhere
+    for (auto member : members)
+    {
+        if (member->_rxSyncStream != nullptr and member->_rxSyncStream->active)
+        {
+            throw std::runtime_error("syncGroupTime() a group member has an active rx stream");
+        }
+        if (member->_rxSampRate != _rxSampRate)
+        {
+            throw std::runtime_error("syncGroupTime() the group members have different rx sample rates");
+        }
+    }
+
+    //gate rx0 of every member on the trigger line, this device drives it
+    std::vector<struct bladerf_trigger> triggers(members.size());
+    std::vector<int> results(members.size(), 0);
+    std::vector<bladerf_timestamp> edges(members.size(), 0);
+    int ret = 0;
+    size_t armed = 0;
+    for (; armed < members.size() and ret == 0; armed++)
+    {
+        auto member = members[armed];
+        auto &trigger = triggers[armed];
+        const bladerf_trigger_signal signal = member->_isBladeRF1?BLADERF_TRIGGER_J71_4:BLADERF_TRIGGER_MINI_EXP_1;
+
+        //the previous stream configuration is replaced by the gated capture below
+        member->releaseStreamConfig(SOAPY_SDR_RX);
+        member->_rxSyncStream = nullptr;
+
+        ret = bladerf_trigger_init(member->_dev, BLADERF_CHANNEL_RX(0), signal, &trigger);
+        if (ret != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_trigger_init() returned %s", _err2str(ret).c_str());
+            break;
+        }
+        trigger.role = (member == this)?BLADERF_TRIGGER_ROLE_MASTER:BLADERF_TRIGGER_ROLE_SLAVE;
+
+        ret = bladerf_trigger_arm(member->_dev, &trigger, true, 0, 0);
+        if (ret != 0) SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_trigger_arm() returned %s", _err2str(ret).c_str());
+        if (ret == 0) ret = bladerf_sync_config(member->_dev, BLADERF_RX_X1, BLADERF_FORMAT_SC16_Q11_META,
+            GROUP_SYNC_NUM_BUFFS, GROUP_SYNC_BUFF_LEN, GROUP_SYNC_NUM_XFERS, GROUP_SYNC_TIMEOUT_MS);
+        if (ret == 0) ret = bladerf_enable_module(member->_dev, BLADERF_CHANNEL_RX(0), true);
+        if (ret != 0) SoapySDR::logf(SOAPY_SDR_ERROR, "syncGroupTime() capture setup returned %s", _err2str(ret).c_str());
+    }
+
+    //every member blocks until the first gated samples arrive, their timestamp is the edge
+    if (ret == 0)
+    {
+        std::vector<std::thread> captures;
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            captures.push_back(std::thread([&, i](void)
+            {
+                std::vector<int16_t> buff(2*GROUP_SYNC_BUFF_LEN);
+                bladerf_metadata md;
+                std::memset(&md, 0, sizeof(md));
+                md.flags = BLADERF_META_FLAG_RX_NOW;
+                results[i] = bladerf_sync_rx(members[i]->_dev, buff.data(), GROUP_SYNC_BUFF_LEN, &md, GROUP_SYNC_TIMEOUT_MS);
+                edges[i] = md.timestamp;
+            }));
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(GROUP_ARM_SETTLE_MS));
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            if (members[i] != this) continue;
+            ret = bladerf_trigger_fire(_dev, &triggers[i]);
+            if (ret != 0) SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_trigger_fire() returned %s", _err2str(ret).c_str());
+        }
+        for (auto &capture : captures) capture.join();
+        for (const auto result : results) if (ret == 0) ret = result;
+    }
+
+    //disarm and forget the capture so that the next stream re-applies its configuration
+    for (size_t i = 0; i < armed; i++)
+    {
+        auto member = members[i];
+        bladerf_trigger_arm(member->_dev, &triggers[i], false, 0, 0);
+        bladerf_enable_module(member->_dev, BLADERF_CHANNEL_RX(0), false);
+        member->_rxSyncConfig = SyncConfig();
+    }
+
+    if (ret != 0) throw std::runtime_error("syncGroupTime() " + _err2str(ret));
+
+    //the counters keep running, the same edge maps to timeNs through each offset
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        auto member = members[i];
+        member->_timeNsOffset = timeNs - SoapySDR::ticksToTimeNs(edges[i], member->_rxSampRate);
+        member->_invalidateClock();
+        member->invalidateTxClock();
+        SoapySDR::logf(SOAPY_SDR_DEBUG, "syncGroupTime() member %d edge at %lld ticks", int(i), (long long)edges[i]);
+    }
+    SoapySDR::logf(SOAPY_SDR_INFO, "syncGroupTime() aligned %d devices", int(members.size()));
+}
+
+/*******************************************************************
+ * Group streams
+ ******************************************************************/
+
+std::vector<SoapySDR::Stream *> bladeRF_SoapySDR::setupGroupStreams(
+    const int direction,
+    const std::string &format,
+    const std::vector<size_t> &channels,
+    const SoapySDR::Kwargs &args)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    const auto members = this->groupMembers();
+
+    std::vector<SoapySDR::Stream *> streams;
+    try
+    {
+        for (auto member : members) streams.push_back(member->setupStream(direction, format, channels, args));
+    }
+    catch (...)
+    {
+        for (size_t i = 0; i < streams.size(); i++) members[i]->closeStream(streams[i]);
+        throw;
+    }
+    return streams;
+}
+
+int bladeRF_SoapySDR::activateGroupStreams(const std::vector<SoapySDR::Stream *> &streams, const long long timeNs, const size_t numElems)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    const auto members = this->groupMembers();
+    if (streams.size() != members.size()) throw std::runtime_error("activateGroupStreams() expects one stream per group member");
+
+    //rx streams begin at one time, tx streams are timed by their writes
+    const long long startNs = (timeNs != 0)?timeNs:(this->getHardwareTime() + GROUP_START_LEAD_NS);
+    int result = 0;
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        const StreamState *state = reinterpret_cast<const StreamState *>(streams[i]);
+        const bool timed = (state->direction == SOAPY_SDR_RX);
+        const int ret = members[i]->activateStream(streams[i], timed?SOAPY_SDR_HAS_TIME:0, timed?startNs:0, numElems);
+        if (ret != 0 and result == 0) result = ret;
+    }
+    return result;
+}
+
+int bladeRF_SoapySDR::deactivateGroupStreams(const std::vector<SoapySDR::Stream *> &streams)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    const auto members = this->groupMembers();
+    if (streams.size() != members.size()) throw std::runtime_error("deactivateGroupStreams() expects one stream per group member");
+
+    int result = 0;
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        const int ret = members[i]->deactivateStream(streams[i], 0, 0);
+        if (ret != 0 and result == 0) result = ret;
+    }
+    return result;
+}
+
+void bladeRF_SoapySDR::closeGroupStreams(const std::vector<SoapySDR::Stream *> &streams)
+{
+    std::lock_guard<std::mutex> lock(groupMutex());
+    const auto members = this->groupMembers();
+    if (streams.size() != members.size()) throw std::runtime_error("closeGroupStreams() expects one stream per group member");
+
+    for (size_t i = 0; i < members.size(); i++) members[i]->closeStream(streams[i]);
+}
@@ -0,0 +1,219 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bladeRF_RecordFile.hpp"
+#include <SoapySDR/Logger.hpp>
+#include <stdexcept>
+#include <algorithm> //min
+#include <cstdlib> //posix_memalign
+#include <cstring> //strerror
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//! Chunks per mapped window, the mapping slides along the file
+#define RECORD_WINDOW_CHUNKS 256
+
+//! Chunks staged before an O_DIRECT write
+#define RECORD_STAGE_CHUNKS 16
+
+//! O_DIRECT offset, size, and address alignment
+#define RECORD_DIRECT_ALIGN 4096
+
+static std::string lastError(const std::string &what)
+{
+    return what + " " + std::string(strerror(errno));
+}
+
+#ifdef _WIN32
+
+RecordFile::RecordFile(const std::string &path, const size_t chunkBytes, const unsigned long long maxBytes, const bool direct):
+    _path(path), _chunkBytes(chunkBytes), _maxBytes(maxBytes), _direct(direct)
+{
+    throw std::runtime_error("RecordFile is not supported on this platform");
+}
+
+RecordFile::~RecordFile(void) {}
+void RecordFile::comment(const std::string &) {}
+size_t RecordFile::room(void) const {return 0;}
+void *RecordFile::next(void) {return nullptr;}
+void RecordFile::commit(const size_t, const unsigned long long, const long long, const bool) {}
+void RecordFile::flushStage(const bool) {}
+
+#else
+
+RecordFile::RecordFile(const std::string &path, const size_t chunkBytes, const unsigned long long maxBytes, const bool direct):
+    _path(path),
+    _chunkBytes(chunkBytes),
+    _maxBytes(maxBytes),
+    _direct(direct),
+    _fd(-1),
+    _index(nullptr),
+    _pos(0),
+    _window(nullptr),
+    _windowOffset(0),
+    _windowBytes(0),
+    _stage(nullptr),
+    _stageBytes(0),
+    _stageFill(0)
+{
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+    #ifdef O_DIRECT
+    if (direct) flags |= O_DIRECT;
+    #else
+    if (direct) throw std::runtime_error("RecordFile O_DIRECT is not supported on this platform");
+    #endif
+
+    _fd = open(path.c_str(), flags, 0644);
+    if (_fd < 0) throw std::runtime_error(lastError("RecordFile open(" + path + ")"));
+
+    _index = std::fopen((path + ".idx").c_str(), "w");
+    if (_index == nullptr)
+    {
+        close(_fd);
+        throw std::runtime_error(lastError("RecordFile fopen(" + path + ".idx)"));
+    }
+    std::setvbuf(_index, nullptr, _IOFBF, 1 << 16);
+
+    const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    _windowBytes = ((chunkBytes*RECORD_WINDOW_CHUNKS + pageSize - 1)/pageSize)*pageSize;
+
+    //the slack keeps room for a whole chunk after an unaligned remainder
+    if (direct)
+    {
+        _stageBytes = chunkBytes*RECORD_STAGE_CHUNKS + RECORD_DIRECT_ALIGN;
+        void *stage = nullptr;
+        if (posix_memalign(&stage, RECORD_DIRECT_ALIGN, _stageBytes) != 0)
+        {
+            std::fclose(_index);
+            close(_fd);
+            throw std::runtime_error("RecordFile staging buffer allocation failed");
+        }
+        _stage = (unsigned char *)stage;
+    }
+}
+
+RecordFile::~RecordFile(void)
+{
+    try
+    {
+        if (_direct) this->flushStage(true);
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "RecordFile %s", ex.what());
+    }
+
+    if (_window != nullptr) munmap(_window, _windowBytes);
+    if (ftruncate(_fd, off_t(_pos)) != 0) SoapySDR::logf(SOAPY_SDR_ERROR, "%s", lastError("RecordFile ftruncate()").c_str());
+    close(_fd);
+    std::fclose(_index);
+    std::free(_stage);
+}
+
+void RecordFile::comment(const std::string &line)
+{
+    std::fprintf(_index, "# %s\n", line.c_str());
+}
+
+size_t RecordFile::room(void) const
+{
+    if (_maxBytes == 0) return _chunkBytes;
+    if (_pos >= _maxBytes) return 0;
+    return size_t(std::min<unsigned long long>(_chunkBytes, _maxBytes - _pos));
+}
+
+void *RecordFile::next(void)
+{
+    if (_direct) return _stage + _stageFill;
+
+    //slide the mapping when the chunk would cross its end
+    if (_window == nullptr or _pos + _chunkBytes > _windowOffset + _windowBytes)
+    {
+        if (_window != nullptr) munmap(_window, _windowBytes);
+        _window = nullptr;
+
+        const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+        _windowOffset = _pos - (_pos % pageSize);
+
+        //the file has to cover the mapping, stores past the end raise SIGBUS
+        const off_t end = off_t(_windowOffset + _windowBytes);
+        const int ret = posix_fallocate(_fd, off_t(_windowOffset), off_t(_windowBytes));
+        if (ret == ENOSPC) throw std::runtime_error("RecordFile " + _path + " is out of space");
+        if (ret != 0 and ftruncate(_fd, end) != 0) throw std::runtime_error(lastError("RecordFile ftruncate()"));
+
+        void *window = mmap(nullptr, _windowBytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, off_t(_windowOffset));
+        if (window == MAP_FAILED) throw std::runtime_error(lastError("RecordFile mmap()"));
+        _window = (unsigned char *)window;
+        #ifdef MADV_SEQUENTIAL
+        madvise(_window, _windowBytes, MADV_SEQUENTIAL);
+        #endif
+    }
+
+    return _window + (_pos - _windowOffset);
+}
+
+void RecordFile::commit(const size_t numBytes, const unsigned long long ticks, const long long timeNs, const bool overrun)
+{
+    std::fprintf(_index, "%llu %llu %llu %lld%s\n", _pos, (unsigned long long)numBytes, ticks, timeNs, overrun?" overrun":"");
+    _pos += numBytes;
+
+    if (_direct)
+    {
+        _stageFill += numBytes;
+        if (_stageBytes - _stageFill < _chunkBytes) this->flushStage(false);
+    }
+}
+
+void RecordFile::flushStage(const bool all)
+{
+    //the stage starts at an aligned file offset, only whole blocks go out with O_DIRECT
+    const unsigned long long offset = _pos - _stageFill;
+    size_t numBytes = all?_stageFill:(_stageFill - (_stageFill % RECORD_DIRECT_ALIGN));
+    if (numBytes == 0) return;
+
+    //the unaligned tail is written without O_DIRECT
+    if (all and (numBytes % RECORD_DIRECT_ALIGN) != 0)
+    {
+        const int flags = fcntl(_fd, F_GETFL);
+        #ifdef O_DIRECT
+        if (flags >= 0) fcntl(_fd, F_SETFL, flags & ~O_DIRECT);
+        #endif
+    }
+
+    size_t done = 0;
+    while (done < numBytes)
+    {
+        const ssize_t ret = pwrite(_fd, _stage + done, numBytes - done, off_t(offset + done));
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret <= 0) throw std::runtime_error(lastError("RecordFile pwrite()"));
+        done += size_t(ret);
+    }
+
+    std::memmove(_stage, _stage + numBytes, _stageFill - numBytes);
+    _stageFill -= numBytes;
+}
+
+#endif
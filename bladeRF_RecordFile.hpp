@@ -0,0 +1,89 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/*!
+ * A raw sample file written in chunks with a text index next to it.
+ * Chunks are received in place, either straight into a sliding shared
+ * mapping of the file, or into an aligned staging buffer that is written
+ * with O_DIRECT. The index "<path>.idx" has one line per chunk with the
+ * byte offset, the sample count, the hardware ticks and time of the first
+ * sample, and an overrun marker when samples were lost before the chunk.
+ */
+class RecordFile
+{
+public:
+
+    /*!
+     * Create or truncate the file and its index.
+     * \param chunkBytes the largest chunk that is passed to commit()
+     * \param maxBytes stop at this file size, 0 for no limit
+     * \param direct write with O_DIRECT instead of mapping the file
+     */
+    RecordFile(const std::string &path, const size_t chunkBytes, const unsigned long long maxBytes, const bool direct);
+
+    //! Flushes the remaining samples and truncates the file to the recorded size
+    ~RecordFile(void);
+
+    //! Add a comment line to the index
+    void comment(const std::string &line);
+
+    //! Bytes that the next chunk may take, 0 when the file is full
+    size_t room(void) const;
+
+    //! Where to receive the next chunk, valid for room() bytes until commit()
+    void *next(void);
+
+    //! Keep the numBytes received at next() and index them
+    void commit(const size_t numBytes, const unsigned long long ticks, const long long timeNs, const bool overrun);
+
+    //! Bytes recorded so far
+    unsigned long long size(void) const
+    {
+        return _pos;
+    }
+
+private:
+    void flushStage(const bool all);
+
+    const std::string _path;
+    const size_t _chunkBytes;
+    const unsigned long long _maxBytes;
+    const bool _direct;
+    int _fd;
+    std::FILE *_index;
+    unsigned long long _pos; //bytes committed
+
+    //mapped mode
+    unsigned char *_window;
+    unsigned long long _windowOffset;
+    size_t _windowBytes;
+
+    //O_DIRECT mode
+    unsigned char *_stage;
+    size_t _stageBytes;
+    size_t _stageFill; //committed bytes not written yet
+};
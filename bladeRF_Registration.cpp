@@ -22,9 +22,20 @@
 #include <SoapySDR/Registry.hpp>
 #include "bladeRF_SoapySDR.hpp"
 #include <cstdio>
+#include <algorithm> //max
 #include <sstream>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <chrono>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+//! How long a device list is reused by find_bladeRF(), override with the enum_cache_ms arg
+#define DEF_ENUM_CACHE_MS 2000
 
 static SoapySDR::Kwargs devinfo_to_kwargs(const bladerf_devinfo &info)
 {
@@ -79,36 +90,120 @@ static bladerf_devinfo kwargs_to_devinfo(const SoapySDR::Kwargs &args)
     return info;
 }
 
+/***********************************************************************
+ * Enumeration cache
+ **********************************************************************/
+
+struct EnumCache
+{
+    std::mutex mutex;
+    bool valid = false;
+    std::chrono::steady_clock::time_point time;
+    std::string usbStamp;
+    std::vector<bladerf_devinfo> infos;
+};
+
+static EnumCache &getEnumCache(void)
+{
+    static EnumCache cache;
+    return cache;
+}
+
+//! A summary of the USB device nodes that changes on hotplug, empty when not available
+static std::string usbHotplugStamp(void)
+{
+    std::string stamp;
+    #ifdef __linux__
+    //a bus directory is modified when a device node is added to or removed from it
+    DIR *dir = opendir("/dev/bus/usb");
+    if (dir == nullptr) return stamp;
+    while (struct dirent *ent = readdir(dir))
+    {
+        if (ent->d_name[0] == '.') continue;
+        struct stat st;
+        const std::string path = std::string("/dev/bus/usb/") + ent->d_name;
+        if (stat(path.c_str(), &st) != 0) continue;
+        stamp += std::string(ent->d_name) + "@" + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) + " ";
+    }
+    closedir(dir);
+    #endif
+    return stamp;
+}
+
+//! The libbladeRF device list, rescanned when it is older than ttlMs or a hotplug happened
+static std::vector<bladerf_devinfo> getDeviceList(const long ttlMs)
+{
+    EnumCache &cache = getEnumCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    const auto now = std::chrono::steady_clock::now();
+    const std::string usbStamp = usbHotplugStamp();
+    if (cache.valid and now - cache.time < std::chrono::milliseconds(ttlMs) and usbStamp == cache.usbStamp) return cache.infos;
+
+    bladerf_devinfo *infos = NULL;
+    const int ret = bladerf_get_device_list(&infos);
+    cache.infos.assign(infos, infos + std::max(ret, 0));
+    if (infos != NULL) bladerf_free_device_list(infos);
+
+    cache.valid = true;
+    cache.time = now;
+    cache.usbStamp = usbStamp;
+    return cache.infos;
+}
+
+static void invalidateDeviceList(void)
+{
+    EnumCache &cache = getEnumCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.valid = false;
+}
+
+/***********************************************************************
+ * Find and factory
+ **********************************************************************/
+
 static std::vector<SoapySDR::Kwargs> find_bladeRF(const SoapySDR::Kwargs &matchArgs)
 {
     const bladerf_devinfo matchinfo = kwargs_to_devinfo(matchArgs);
+    const long ttlMs = (matchArgs.count("enum_cache_ms") == 0)? DEF_ENUM_CACHE_MS : std::atol(matchArgs.at("enum_cache_ms").c_str());
 
     std::vector<SoapySDR::Kwargs> results;
-    bladerf_devinfo *infos = NULL;
-    int ret = 0;
-    ret = bladerf_get_device_list(&infos);
-
-    for (int i = 0; i < ret; i++)
+    for (const auto &info : getDeviceList(ttlMs))
     {
-        if (bladerf_devinfo_matches(infos+i, &matchinfo))
+        if (bladerf_devinfo_matches(&info, &matchinfo))
         {
-            results.push_back(devinfo_to_kwargs(infos[i]));
+            results.push_back(devinfo_to_kwargs(info));
         }
     }
 
-    bladerf_free_device_list(infos);
     return results;
 }
 
 static SoapySDR::Device *make_bladeRF(const SoapySDR::Kwargs &args)
 {
-    SoapySDR::Device *bladerf = new bladeRF_SoapySDR(kwargs_to_devinfo(args));
+    //no shared state is held while opening, so SoapySDR can make several devices in parallel
+    bladeRF_SoapySDR *bladerf = nullptr;
+    try
+    {
+        const bool fastOpen = (args.count("fast_open") != 0) and (args.at("fast_open") == "true" or args.at("fast_open") == "1");
+        bladerf = new bladeRF_SoapySDR(kwargs_to_devinfo(args), fastOpen);
+    }
+    catch (...)
+    {
+        //the cached list may name a device that is gone
+        invalidateDeviceList();
+        throw;
+    }
 
     //apply applicable settings found in args
-    for (const auto &info : bladerf->getSettingInfo())
+    try
+    {
+        bladerf->writeSettings(args);
+    }
+    catch (...)
     {
-        if (args.count(info.key) == 0) continue;
-        bladerf->writeSetting(info.key, args.at(info.key));
+        delete bladerf;
+        throw;
     }
 
     return bladerf;
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bladeRF_ReplayFile.hpp"
+#include <stdexcept>
+#include <cstring> //strerror
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+ReplayFile::ReplayFile(const std::string &):
+    _fd(-1), _data(nullptr), _size(0)
+{
+    throw std::runtime_error("ReplayFile is not supported on this platform");
+}
+
+ReplayFile::~ReplayFile(void) {}
+
+#else
+
+ReplayFile::ReplayFile(const std::string &path):
+    _fd(-1),
+    _data(nullptr),
+    _size(0)
+{
+    _fd = open(path.c_str(), O_RDONLY);
+    if (_fd < 0) throw std::runtime_error("ReplayFile open(" + path + ") " + strerror(errno));
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 or st.st_size == 0)
+    {
+        close(_fd);
+        throw std::runtime_error("ReplayFile " + path + " is empty or unreadable");
+    }
+    _size = size_t(st.st_size);
+
+    void *data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(_fd);
+        throw std::runtime_error("ReplayFile mmap(" + path + ") " + strerror(errno));
+    }
+    _data = data;
+
+    //playback reads front to back, looping keeps the pages that fit in memory
+    #ifdef MADV_SEQUENTIAL
+    madvise(data, _size, MADV_SEQUENTIAL);
+    #endif
+}
+
+ReplayFile::~ReplayFile(void)
+{
+    munmap(const_cast<void *>(_data), _size);
+    close(_fd);
+}
+
+#endif
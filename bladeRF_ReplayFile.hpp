@@ -0,0 +1,54 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*!
+ * A raw sample file mapped read only for playback.
+ * libbladeRF reads the samples straight from the mapping.
+ */
+class ReplayFile
+{
+public:
+
+    //! Map the whole file, throws when it can not be opened or is empty
+    ReplayFile(const std::string &path);
+
+    ~ReplayFile(void);
+
+    const void *data(void) const
+    {
+        return _data;
+    }
+
+    size_t size(void) const
+    {
+        return _size;
+    }
+
+private:
+    int _fd;
+    const void *_data;
+    size_t _size;
+};
@@ -25,6 +25,30 @@
 #include <stdexcept>
 #include <cstdio>
 #include <cmath>
+#include <sstream>
+#include <cstring> //memcmp
+#include <memory>
+
+//! Hardware time reads between getHardwareTime() extrapolations
+#define DEF_CLOCK_RESYNC_MS 1000
+
+//! Shortest interval between hardware time reads used to measure the drift
+#define CLOCK_DRIFT_MIN_S 0.1
+
+//! Quick tune profiles available until the FPGA is reloaded (NUM_BBP_FASTLOCK_PROFILES)
+#define MAX_QUICK_TUNE_PROFILES 256
+
+//! Frequencies closer than this share a quick tune
+#define DEF_QUICK_TUNE_TOLERANCE 1.0 //Hz
+
+//! Identifies a quick tune file and its layout version
+#define QUICK_TUNE_FILE_MAGIC "SBRFQT01"
+
+//! Retry interval of a full retune queue when no queued retune time is known
+#define HOP_RETRY_NS 1000000
+
+//dropped hops remembered for hopMissed()
+#define HOP_FAILURE_HISTORY 256
 
 //! convert bladerf range to a soapysdr range
 static SoapySDR::Range toRange(const bladerf_range* range)
@@ -32,30 +56,124 @@ static SoapySDR::Range toRange(const bladerf_range* range)
     return SoapySDR::Range(range->min*range->scale, range->max*range->scale, range->step*range->scale);
 }
 
+//! parse a channel such as "RX0" from a setting value
+static void parseChannel(const std::string &chan, int &direction, size_t &channel)
+{
+    if (chan.size() < 3 or (chan.compare(0, 2, "RX") != 0 and chan.compare(0, 2, "TX") != 0))
+    {
+        throw std::runtime_error("invalid channel '" + chan + "'");
+    }
+    direction = (chan.compare(0, 2, "RX") == 0)?SOAPY_SDR_RX:SOAPY_SDR_TX;
+    channel = size_t(std::stoul(chan.substr(2)));
+}
+
+//! parse a quick_tune_sweep setting, "RX0,f0,f1,..." or "RX0,start:stop:step"
+static std::vector<double> parseFrequencyList(const std::string &value, int &direction, size_t &channel)
+{
+    std::vector<std::string> fields;
+    std::stringstream ss(value);
+    std::string field;
+    while (std::getline(ss, field, ',')) fields.push_back(field);
+    if (fields.size() < 2) throw std::runtime_error("quick_tune_sweep expects a channel and frequencies");
+    parseChannel(fields[0], direction, channel);
+
+    std::vector<double> frequencies;
+    for (size_t i = 1; i < fields.size(); i++)
+    {
+        const size_t colon = fields[i].find(':');
+        if (colon == std::string::npos)
+        {
+            frequencies.push_back(std::stod(fields[i]));
+            continue;
+        }
+        const size_t colon2 = fields[i].find(':', colon+1);
+        if (colon2 == std::string::npos) throw std::runtime_error("quick_tune_sweep range expects start:stop:step");
+        const double start = std::stod(fields[i].substr(0, colon));
+        const double stop = std::stod(fields[i].substr(colon+1, colon2-colon-1));
+        const double step = std::stod(fields[i].substr(colon2+1));
+        if (step <= 0) throw std::runtime_error("quick_tune_sweep range step must be positive");
+        for (size_t n = 0; start + n*step <= stop + step*1e-9; n++) frequencies.push_back(start + n*step);
+    }
+    return frequencies;
+}
+
+//! parse a hop_schedule setting, entries "RX0,timeNs,frequency,gain" separated by ';'
+static std::vector<HopCommand> parseHops(const std::string &value)
+{
+    std::vector<HopCommand> hops;
+    std::stringstream entries(value);
+    std::string entry;
+    while (std::getline(entries, entry, ';'))
+    {
+        if (entry.empty()) continue;
+        std::vector<std::string> fields;
+        std::stringstream ss(entry);
+        std::string field;
+        while (std::getline(ss, field, ',')) fields.push_back(field);
+        fields.resize(4);
+
+        HopCommand hop;
+        parseChannel(fields[0], hop.direction, hop.channel);
+        hop.timeNs = fields[1].empty()?0:std::stoll(fields[1]);
+        hop.frequency = fields[2].empty()?NAN:std::stod(fields[2]);
+        hop.gain = fields[3].empty()?NAN:std::stod(fields[3]);
+        hops.push_back(hop);
+    }
+    return hops;
+}
+
+//! Parse "NAME:a=b,a=b,..." or "NAME:a/b,..." into (a, b) pairs, numbers may be hex
+static std::vector<std::pair<unsigned, unsigned>> parsePairs(const std::string &value, const char sep, std::string &name)
+{
+    const size_t colon = value.find(':');
+    if (colon == std::string::npos) throw std::runtime_error("expected NAME:pairs, got " + value);
+    name = value.substr(0, colon);
+
+    std::vector<std::pair<unsigned, unsigned>> pairs;
+    std::stringstream entries(value.substr(colon+1));
+    std::string entry;
+    while (std::getline(entries, entry, ','))
+    {
+        if (entry.empty()) continue;
+        const size_t pos = entry.find(sep);
+        if (pos == std::string::npos) throw std::runtime_error("invalid entry " + entry);
+        pairs.emplace_back(
+            unsigned(std::stoul(entry.substr(0, pos), nullptr, 0)),
+            unsigned(std::stoul(entry.substr(pos+1), nullptr, 0)));
+    }
+    return pairs;
+}
+
 /*******************************************************************
  * Device init/shutdown
  ******************************************************************/
 
-bladeRF_SoapySDR::bladeRF_SoapySDR(const bladerf_devinfo &devinfo):
+bladeRF_SoapySDR::bladeRF_SoapySDR(const bladerf_devinfo &devinfo, const bool fastOpen):
     _isBladeRF1(false),
     _rxSampRate(1.0),
     _txSampRate(1.0),
-    _inTxBurst(false),
-    _rxFloats(false),
-    _txFloats(false),
-    _rxOverflow(false),
-    _rxNextTicks(0),
-    _txNextTicks(0),
     _timeNsOffset(0),
-    _rxBuffSize(0),
-    _txBuffSize(0),
-    _rxMinTimeoutMs(0),
+    _rxSyncStream(nullptr),
+    _txSyncStream(nullptr),
+    _clockValid(false),
+    _clockTicks(0),
+    _clockSyncTicks(0),
+    _clockDrift(0.0),
+    _clockResyncMs(DEF_CLOCK_RESYNC_MS),
     _xb200Mode("disabled"),
     _samplingMode("internal"),
     _loopbackMode("disabled"),
-    _dev(NULL)
+    _dev(NULL),
+    _quickTuneTolerance(DEF_QUICK_TUNE_TOLERANCE),
+    _hopDone(false),
+    _hopGeneration(0),
+    _telemetryIntervalMs(0),
+    _telemetryDone(false),
+    _settingsGeneration(0)
 
 {
+    this->_invalidateQuickTunes();
+
     bladerf_devinfo info = devinfo;
     SoapySDR::logf(SOAPY_SDR_INFO, "bladerf_open_with_devinfo()");
     int ret = bladerf_open_with_devinfo(&_dev, &info);
@@ -73,6 +191,14 @@ bladeRF_SoapySDR::bladeRF_SoapySDR(const bladerf_devinfo &devinfo):
     ret = bladerf_get_serial_struct(_dev, &serial);
     if (ret == 0) SoapySDR::logf(SOAPY_SDR_INFO, "bladerf_get_serial() = %s", serial.serial);
 
+    //fast open keeps the rates libbladeRF initialized, the hardware time starts from the counter
+    if (fastOpen)
+    {
+        _rxSampRate = this->getSampleRate(SOAPY_SDR_RX, 0);
+        _txSampRate = this->getSampleRate(SOAPY_SDR_TX, 0);
+        return;
+    }
+
     //initialize the sample rates to something
     this->setSampleRate(SOAPY_SDR_RX, 0, 4e6);
     this->setSampleRate(SOAPY_SDR_TX, 0, 4e6);
@@ -80,6 +206,21 @@ bladeRF_SoapySDR::bladeRF_SoapySDR(const bladerf_devinfo &devinfo):
 
 bladeRF_SoapySDR::~bladeRF_SoapySDR(void)
 {
+    //group calls on other members may use this device
+    this->joinGroup("");
+    this->setTelemetryInterval(0);
+
+    //the hop thread uses the device
+    {
+        std::lock_guard<std::mutex> lock(_hopMutex);
+        _hopDone = true;
+    }
+    _hopCond.notify_one();
+    if (_hopThread.joinable()) _hopThread.join();
+
+    //rx channels stay enabled after closeStream() for the setup fast path
+    if (_dev != NULL) try {this->releaseStreamConfig(SOAPY_SDR_RX);} catch (...) {}
+
     SoapySDR::logf(SOAPY_SDR_INFO, "bladerf_close()");
     if (_dev != NULL) bladerf_close(_dev);
 }
@@ -322,6 +463,8 @@ void bladeRF_SoapySDR::setGainMode(const int direction, const size_t channel, co
     if (direction == SOAPY_SDR_TX) return; //not supported on tx
     bladerf_gain_mode gain_mode = automatic ? BLADERF_GAIN_AUTOMATIC : BLADERF_GAIN_MANUAL;
     const int ret = bladerf_set_gain_mode(_dev, _toch(direction, channel), gain_mode);
+    this->_forgetSettings(SETTING_GAIN_MODE, direction);
+    this->_forgetSettings(SETTING_GAIN, direction);
     if (ret != 0 and automatic) //only throw when mode is automatic, manual is default even when call bombs
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_set_gain_mode(%s) returned %s", automatic?"automatic":"manual", _err2str(ret).c_str());
@@ -332,6 +475,12 @@ void bladeRF_SoapySDR::setGainMode(const int direction, const size_t channel, co
 bool bladeRF_SoapySDR::getGainMode(const int direction, const size_t channel) const
 {
     if (direction == SOAPY_SDR_TX) return false; //not supported on tx
+
+    const unsigned key = _settingKey(SETTING_GAIN_MODE, direction, channel);
+    double cached(0);
+    unsigned long long generation(0);
+    if (this->_getCachedSetting(key, cached, generation)) return cached != 0.0;
+
     bladerf_gain_mode gain_mode;
     int ret = bladerf_get_gain_mode(_dev, _toch(direction, channel), &gain_mode);
     if (ret != 0)
@@ -339,7 +488,9 @@ bool bladeRF_SoapySDR::getGainMode(const int direction, const size_t channel) co
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_get_gain_mode() returned %s", _err2str(ret).c_str());
         throw std::runtime_error("getGainMode() " + _err2str(ret));
     }
-    return gain_mode == BLADERF_GAIN_AUTOMATIC;
+    const bool automatic = (gain_mode == BLADERF_GAIN_AUTOMATIC);
+    this->_cacheSetting(key, automatic?1.0:0.0, generation);
+    return automatic;
 }
 
 std::vector<std::string> bladeRF_SoapySDR::listGains(const int direction, const size_t channel) const
@@ -361,6 +512,7 @@ std::vector<std::string> bladeRF_SoapySDR::listGains(const int direction, const
 void bladeRF_SoapySDR::setGain(const int direction, const size_t channel, const double value)
 {
     const int ret = bladerf_set_gain(_dev, _toch(direction, channel), bladerf_gain(std::round(value)));
+    this->_forgetSettings(SETTING_GAIN, direction);
     if (ret != 0)
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_set_gain(%f) returned %s", value, _err2str(ret).c_str());
@@ -371,6 +523,7 @@ void bladeRF_SoapySDR::setGain(const int direction, const size_t channel, const
 void bladeRF_SoapySDR::setGain(const int direction, const size_t channel, const std::string &name, const double value)
 {
     int ret = bladerf_set_gain_stage(_dev, _toch(direction, channel), name.c_str(), bladerf_gain(std::round(value)));
+    this->_forgetSettings(SETTING_GAIN, direction);
     if (ret != 0)
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_set_gain_stage(%s, %f) returned %s", name.c_str(), value, _err2str(ret).c_str());
@@ -380,6 +533,11 @@ void bladeRF_SoapySDR::setGain(const int direction, const size_t channel, const
 
 double bladeRF_SoapySDR::getGain(const int direction, const size_t channel) const
 {
+    const unsigned key = _settingKey(SETTING_GAIN, direction, channel);
+    double cached(0);
+    unsigned long long generation(0);
+    if (this->_getCachedSetting(key, cached, generation)) return cached;
+
     bladerf_gain gain(0);
     const int ret = bladerf_get_gain(_dev, _toch(direction, channel), &gain);
     if (ret != 0)
@@ -387,6 +545,12 @@ double bladeRF_SoapySDR::getGain(const int direction, const size_t channel) cons
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_get_gain() returned %s", _err2str(ret).c_str());
         throw std::runtime_error("getGain() " + _err2str(ret));
     }
+
+    //the automatic gain control moves the gain on its own, an unknown mode counts as automatic
+    bool automatic = true;
+    try {automatic = this->getGainMode(direction, channel);}
+    catch (const std::exception &) {}
+    if (not automatic) this->_cacheSetting(key, double(gain), generation);
     return double(gain);
 }
 
@@ -454,19 +618,7 @@ void bladeRF_SoapySDR::setFrequency(const int direction, const size_t channel, c
             throw std::runtime_error("saveQuickTune is only available for BladeRF2.");
         }
 
-        setRfFrequency(direction, channel, frequency);
-
-        auto quickTune = getQuickTune(direction, channel);
-        if (quickTune == nullptr)
-        {
-            SoapySDR::logf(SOAPY_SDR_ERROR, "Cannot set frequency for retune.");
-            throw std::runtime_error("Cannot set frequency for retune.");
-        }
-
-        auto quickTuneIter = _quickTunesByDirChanAndFreq.find({ direction, channel, frequency });
-        if (quickTuneIter != _quickTunesByDirChanAndFreq.end()) delete quickTuneIter->second;
-
-        _quickTunesByDirChanAndFreq[{direction, channel, frequency}] = quickTune;
+        saveQuickTuneAt(direction, channel, frequency);
         return;
     }
 
@@ -481,8 +633,8 @@ void bladeRF_SoapySDR::setFrequency(const int direction, const size_t channel, c
             throw std::runtime_error("reuseQuickTune is only available for BladeRF2.");
         }
 
-        auto quickTuneIter = _quickTunesByDirChanAndFreq.find({ direction, channel, frequency });
-        if (quickTuneIter == _quickTunesByDirChanAndFreq.end())
+        const long handle = findQuickTune(direction, channel, frequency);
+        if (handle < 0)
         {
             SoapySDR::logf(SOAPY_SDR_ERROR, "Unkown quick tune for frequency %f and channel %d", frequency, channel);
             throw std::runtime_error("Unkown quick tune");
@@ -491,7 +643,19 @@ void bladeRF_SoapySDR::setFrequency(const int direction, const size_t channel, c
         auto value = args.find("timestamp");
         long long timestamp = value == args.end() ? 0 : std::stoll(value->second);
 
-        retune(direction, channel, timestamp, quickTuneIter->second);
+        retune(direction, channel, timestamp, &_quickTunes[handle].quickTune);
+        return;
+    }
+
+    //Else, if "quickTuneHandle" is specified, retune with the quick tune of that handle,
+    //the frequency is ignored. "timestamp" works as with reuseQuickTune.
+    auto handleIter = args.find("quickTuneHandle");
+    if (handleIter != args.end())
+    {
+        auto value = args.find("timestamp");
+        long long timestamp = value == args.end() ? 0 : std::stoll(value->second);
+
+        retuneHandle(size_t(std::stoul(handleIter->second)), timestamp);
         return;
     }
 
@@ -501,7 +665,9 @@ void bladeRF_SoapySDR::setFrequency(const int direction, const size_t channel, c
 
 void bladeRF_SoapySDR::setRfFrequency(const int direction, const size_t channel, const double frequency)
 {
+    //the channels of a direction share the LO on the bladeRF2
     int ret = bladerf_set_frequency(_dev, _toch(direction, channel), bladerf_frequency(std::round(frequency)));
+    this->_forgetSettings(SETTING_FREQUENCY, direction);
     if (ret != 0)
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_set_frequency(%f) returned %s", frequency, _err2str(ret).c_str());
@@ -514,6 +680,11 @@ double bladeRF_SoapySDR::getFrequency(const int direction, const size_t channel,
     if (name == "BB") return 0.0; //for compatibility
     if (name != "RF") throw std::runtime_error("getFrequency("+name+") unknown name");
 
+    const unsigned key = _settingKey(SETTING_FREQUENCY, direction, channel);
+    double cached(0);
+    unsigned long long generation(0);
+    if (this->_getCachedSetting(key, cached, generation)) return cached;
+
     bladerf_frequency freq(0);
     int ret = bladerf_get_frequency(_dev, _toch(direction, channel), &freq);
     if (ret != 0)
@@ -521,6 +692,7 @@ double bladeRF_SoapySDR::getFrequency(const int direction, const size_t channel,
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_get_frequency() returned %s", _err2str(ret).c_str());
         throw std::runtime_error("getFrequency("+name+") " + _err2str(ret));
     }
+    this->_cacheSetting(key, double(freq), generation);
     return double(freq);
 }
 
@@ -544,20 +716,87 @@ SoapySDR::RangeList bladeRF_SoapySDR::getFrequencyRange(const int direction, con
     return {toRange(range)};
 }
 
-bladerf_quick_tune* bladeRF_SoapySDR::getQuickTune(const int direction, const size_t channel) const
+bool bladeRF_SoapySDR::getQuickTune(const int direction, const size_t channel, bladerf_quick_tune &quickTune) const
 {
-    bladerf_quick_tune* quick_tune = new bladerf_quick_tune();
     bladerf_channel ch = _toch(direction, channel);
-    int ret = bladerf_get_quick_tune(_dev, ch, quick_tune);
+    int ret = bladerf_get_quick_tune(_dev, ch, &quickTune);
 
     if (ret != 0)
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_get_quick_tune() returned %s", _err2str(ret).c_str());
-        delete quick_tune;
-        return nullptr;
+        return false;
     }
 
-    return quick_tune;
+    return true;
+}
+
+long bladeRF_SoapySDR::findQuickTune(const int direction, const size_t channel, const double frequency) const
+{
+    //a frequency within the tolerance falls in its own bucket or a neighbor,
+    //a bucket can hold several entries, the closest one wins and the later one on a tie
+    const long long bucket = std::llround(frequency/_quickTuneTolerance);
+    long best = -1;
+    double bestDistance = 0.0;
+    for (long long b = bucket-1; b <= bucket+1; b++)
+    {
+        const auto it = _quickTuneIndex.find(_quickTuneKey(direction, channel, b));
+        if (it == _quickTuneIndex.end()) continue;
+        for (const auto handle : it->second)
+        {
+            const double distance = std::abs(_quickTunes[handle].frequency - frequency);
+            if (distance > _quickTuneTolerance) continue;
+            if (best >= 0 and (distance > bestDistance or (distance == bestDistance and long(handle) < best))) continue;
+            best = long(handle);
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+long bladeRF_SoapySDR::getQuickTuneHandle(const int direction, const size_t channel, const double frequency) const
+{
+    return this->findQuickTune(direction, channel, frequency);
+}
+
+size_t bladeRF_SoapySDR::storeQuickTune(const int direction, const size_t channel, const double frequency, const bladerf_quick_tune &quickTune)
+{
+    const long found = findQuickTune(direction, channel, frequency);
+    if (found >= 0)
+    {
+        _quickTunes[found].quickTune = quickTune;
+        return size_t(found);
+    }
+
+    QuickTuneEntry entry;
+    entry.direction = direction;
+    entry.channel = channel;
+    entry.frequency = frequency;
+    entry.quickTune = quickTune;
+    _quickTunes.push_back(entry);
+    _quickTuneIndex[_quickTuneKey(direction, channel, std::llround(frequency/_quickTuneTolerance))].push_back(_quickTunes.size()-1);
+    return _quickTunes.size()-1;
+}
+
+void bladeRF_SoapySDR::reindexQuickTunes(void)
+{
+    _quickTuneIndex.clear();
+    for (size_t i = 0; i < _quickTunes.size(); i++)
+    {
+        const auto &entry = _quickTunes[i];
+        _quickTuneIndex[_quickTuneKey(entry.direction, entry.channel, std::llround(entry.frequency/_quickTuneTolerance))].push_back(i);
+    }
+
+    //a coarser tolerance can put entries within reach of each other, the lookup of
+    //the shadowed ones returns another entry although they still hold a profile
+    size_t shadowed = 0;
+    for (size_t i = 0; i < _quickTunes.size(); i++)
+    {
+        const auto &entry = _quickTunes[i];
+        if (this->findQuickTune(entry.direction, entry.channel, entry.frequency) != long(i)) shadowed++;
+    }
+    if (shadowed != 0) SoapySDR::logf(SOAPY_SDR_WARNING,
+        "quick_tune_tolerance %f Hz merges quick tunes, %d of them are only reachable by handle",
+        _quickTuneTolerance, int(shadowed));
 }
 
 void bladeRF_SoapySDR::retune(const int direction, const size_t channel, long long timestamp, bladerf_quick_tune* quickTune)
@@ -565,6 +804,8 @@ void bladeRF_SoapySDR::retune(const int direction, const size_t channel, long lo
     bladerf_channel ch = _toch(direction, channel);
 
     int ret = bladerf_schedule_retune(_dev, ch, timestamp, 0 /* frequency not needed for retune */, quickTune);
+    if (timestamp == 0) this->_forgetSettings(SETTING_FREQUENCY, direction);
+    else this->_uncacheFrequencies(direction);
 
     if (ret != 0)
     {
@@ -573,6 +814,389 @@ void bladeRF_SoapySDR::retune(const int direction, const size_t channel, long lo
     }
 }
 
+void bladeRF_SoapySDR::retuneHandle(const size_t handle, long long timestamp)
+{
+    if (handle >= _quickTunes.size())
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "Unkown quick tune handle %d", int(handle));
+        throw std::runtime_error("Unkown quick tune handle");
+    }
+    QuickTuneEntry &entry = _quickTunes[handle];
+    retune(entry.direction, entry.channel, timestamp, &entry.quickTune);
+}
+
+int bladeRF_SoapySDR::saveQuickTuneAt(const int direction, const size_t channel, const double frequency)
+{
+    if (_quickTunesLoaded)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "Quick tunes cannot be saved after load_quick_tunes, libbladeRF would reuse the loaded profiles. Use load_fpga or reset first.");
+        throw std::runtime_error("Quick tunes cannot be saved after load_quick_tunes.");
+    }
+
+    if (_quickTuneProfilesUsed(direction) >= MAX_QUICK_TUNE_PROFILES)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "All %d quick tune profiles are used, reload the FPGA to free them.", MAX_QUICK_TUNE_PROFILES);
+        throw std::runtime_error("All quick tune profiles are used.");
+    }
+
+    setRfFrequency(direction, channel, frequency);
+
+    bladerf_quick_tune quickTune;
+    if (!getQuickTune(direction, channel, quickTune))
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "Cannot set frequency for retune.");
+        throw std::runtime_error("Cannot set frequency for retune.");
+    }
+    _quickTuneProfilesUsed(direction)++;
+
+    const long found = findQuickTune(direction, channel, frequency);
+    const int replaced = (found < 0)?-1:int(_quickTunes[found].quickTune.nios_profile);
+    storeQuickTune(direction, channel, frequency, quickTune);
+    return replaced;
+}
+
+QuickTuneSweepResult bladeRF_SoapySDR::sweepQuickTunes(
+    const int direction,
+    const size_t channel,
+    const std::vector<double> &frequencies,
+    const std::function<void(const size_t, const size_t)> &progress)
+{
+    if (!_isBladeRF2) throw std::runtime_error("sweepQuickTunes() is only available for BladeRF2.");
+    if (_quickTunesLoaded) throw std::runtime_error("sweepQuickTunes() is not available after load_quick_tunes, use load_fpga or reset first.");
+
+    const double original = this->getFrequency(direction, channel, "RF");
+    QuickTuneSweepResult result;
+    for (size_t i = 0; i < frequencies.size(); i++)
+    {
+        //profiles are not recycled until the FPGA is reloaded
+        if (_quickTuneProfilesUsed(direction) >= MAX_QUICK_TUNE_PROFILES) result.skipped.push_back(frequencies[i]);
+        else
+        {
+            const int replaced = this->saveQuickTuneAt(direction, channel, frequencies[i]);
+            if (replaced >= 0) result.replaced.push_back(unsigned(replaced));
+            result.saved.push_back(frequencies[i]);
+        }
+        if (progress) progress(i+1, frequencies.size());
+    }
+    this->setRfFrequency(direction, channel, original);
+
+    if (not result.skipped.empty()) SoapySDR::logf(SOAPY_SDR_WARNING,
+        "sweepQuickTunes() all %d quick tune profiles of the direction are used, skipped %d frequencies",
+        MAX_QUICK_TUNE_PROFILES, int(result.skipped.size()));
+    return result;
+}
+
+std::string bladeRF_SoapySDR::quickTuneFileKey(void) const
+{
+    bladerf_serial serial;
+    struct bladerf_version fpgaVersion, fwVersion;
+    int ret = bladerf_get_serial_struct(_dev, &serial);
+    if (ret == 0) ret = bladerf_fpga_version(_dev, &fpgaVersion);
+    if (ret == 0) ret = bladerf_fw_version(_dev, &fwVersion);
+    if (ret != 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "quickTuneFileKey() returned %s", _err2str(ret).c_str());
+        throw std::runtime_error("quickTuneFileKey() " + _err2str(ret));
+    }
+    return std::string(serial.serial) + " fpga " + fpgaVersion.describe + " fw " + fwVersion.describe;
+}
+
+void bladeRF_SoapySDR::saveQuickTunes(const std::string &path) const
+{
+    if (!_isBladeRF2) throw std::runtime_error("saveQuickTunes() is only available for BladeRF2.");
+
+    //header: magic, key length, key, entry size, entry count
+    const std::string key = this->quickTuneFileKey();
+    const uint32_t keyLen = uint32_t(key.size());
+    const uint32_t quickTuneSize = uint32_t(sizeof(bladerf_quick_tune));
+    const uint32_t count = uint32_t(_quickTunes.size());
+
+    //write next to the file and rename so a reader never sees a partial file
+    const std::string tmpPath = path + ".tmp";
+    FILE *fp = std::fopen(tmpPath.c_str(), "wb");
+    if (fp == nullptr) throw std::runtime_error("saveQuickTunes() cannot open " + tmpPath);
+    bool ok = std::fwrite(QUICK_TUNE_FILE_MAGIC, 8, 1, fp) == 1;
+    ok = ok and std::fwrite(&keyLen, sizeof(keyLen), 1, fp) == 1;
+    ok = ok and std::fwrite(key.data(), 1, keyLen, fp) == keyLen;
+    ok = ok and std::fwrite(&quickTuneSize, sizeof(quickTuneSize), 1, fp) == 1;
+    ok = ok and std::fwrite(&count, sizeof(count), 1, fp) == 1;
+
+    //entries: direction, channel, frequency, quick tune
+    for (const auto &entry : _quickTunes)
+    {
+        const int32_t direction = int32_t(entry.direction);
+        const uint32_t channel = uint32_t(entry.channel);
+        ok = ok and std::fwrite(&direction, sizeof(direction), 1, fp) == 1;
+        ok = ok and std::fwrite(&channel, sizeof(channel), 1, fp) == 1;
+        ok = ok and std::fwrite(&entry.frequency, sizeof(entry.frequency), 1, fp) == 1;
+        ok = ok and std::fwrite(&entry.quickTune, quickTuneSize, 1, fp) == 1;
+    }
+    ok = (std::fclose(fp) == 0) and ok;
+
+    if (not ok or std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("saveQuickTunes() failed to write " + path);
+    }
+    SoapySDR::logf(SOAPY_SDR_INFO, "saveQuickTunes(%s) saved %d quick tunes", path.c_str(), int(count));
+}
+
+size_t bladeRF_SoapySDR::loadQuickTunes(const std::string &path)
+{
+    if (!_isBladeRF2) throw std::runtime_error("loadQuickTunes() is only available for BladeRF2.");
+
+    FILE *fp = std::fopen(path.c_str(), "rb");
+    if (fp == nullptr) throw std::runtime_error("loadQuickTunes() cannot open " + path);
+    std::unique_ptr<FILE, int(*)(FILE *)> file(fp, &std::fclose);
+
+    char magic[8];
+    uint32_t keyLen(0), quickTuneSize(0), count(0);
+    if (std::fread(magic, 8, 1, fp) != 1 or std::memcmp(magic, QUICK_TUNE_FILE_MAGIC, 8) != 0 or
+        std::fread(&keyLen, sizeof(keyLen), 1, fp) != 1 or keyLen > 1024)
+    {
+        throw std::runtime_error("loadQuickTunes() " + path + " is not a quick tune file");
+    }
+    std::string key(keyLen, '\0');
+    if (std::fread(&key[0], 1, keyLen, fp) != keyLen or
+        std::fread(&quickTuneSize, sizeof(quickTuneSize), 1, fp) != 1 or
+        std::fread(&count, sizeof(count), 1, fp) != 1)
+    {
+        throw std::runtime_error("loadQuickTunes() " + path + " is truncated");
+    }
+
+    //quick tunes are only meaningful to the device and images that produced them
+    const std::string expected = this->quickTuneFileKey();
+    if (key != expected) throw std::runtime_error("loadQuickTunes() " + path + " was saved for " + key + ", this is " + expected);
+    if (quickTuneSize != sizeof(bladerf_quick_tune)) throw std::runtime_error("loadQuickTunes() " + path + " has a different quick tune layout");
+
+    //profiles saved in this session overwrote the slots that the file points to
+    if (_quickTuneProfilesUsed(SOAPY_SDR_RX) != 0 or _quickTuneProfilesUsed(SOAPY_SDR_TX) != 0)
+    {
+        throw std::runtime_error("loadQuickTunes() quick tunes were saved since the FPGA was loaded, use load_fpga or reset first");
+    }
+
+    //read everything before touching the saved quick tunes
+    std::vector<QuickTuneEntry> entries(count);
+    for (auto &entry : entries)
+    {
+        int32_t direction(0);
+        uint32_t channel(0);
+        double frequency(0);
+        if (std::fread(&direction, sizeof(direction), 1, fp) != 1 or
+            std::fread(&channel, sizeof(channel), 1, fp) != 1 or
+            std::fread(&frequency, sizeof(frequency), 1, fp) != 1 or
+            std::fread(&entry.quickTune, sizeof(bladerf_quick_tune), 1, fp) != 1)
+        {
+            throw std::runtime_error("loadQuickTunes() " + path + " is truncated");
+        }
+        entry.direction = int(direction);
+        entry.channel = size_t(channel);
+        entry.frequency = frequency;
+        if (entry.quickTune.nios_profile >= MAX_QUICK_TUNE_PROFILES) throw std::runtime_error("loadQuickTunes() " + path + " has an invalid profile");
+    }
+
+    for (const auto &entry : entries) storeQuickTune(entry.direction, entry.channel, entry.frequency, entry.quickTune);
+    _quickTunesLoaded = true;
+    SoapySDR::logf(SOAPY_SDR_WARNING, "loadQuickTunes(%s) the quick tunes are only valid if the FPGA was not reloaded or power cycled since they were saved", path.c_str());
+    SoapySDR::logf(SOAPY_SDR_INFO, "loadQuickTunes(%s) loaded %d quick tunes", path.c_str(), int(count));
+    return entries.size();
+}
+
+/*******************************************************************
+ * Hop scheduling
+ ******************************************************************/
+
+void bladeRF_SoapySDR::scheduleHops(const std::vector<HopCommand> &hops)
+{
+    //translate everything up front so the hop thread only talks to the device
+    std::vector<PendingRetune> retunes;
+    std::vector<HopCommand> gains;
+    for (const auto &hop : hops)
+    {
+        if (not std::isnan(hop.frequency))
+        {
+            PendingRetune retune;
+            retune.direction = hop.direction;
+            retune.timeNs = hop.timeNs;
+            retune.ch = _toch(hop.direction, hop.channel);
+            if (hop.timeNs == 0) retune.ticks = BLADERF_RETUNE_NOW;
+            else retune.ticks = bladerf_timestamp((hop.direction == SOAPY_SDR_RX)?_timeNsToRxTicks(hop.timeNs):_timeNsToTxTicks(hop.timeNs));
+            retune.frequency = bladerf_frequency(std::round(hop.frequency));
+            const long handle = findQuickTune(hop.direction, hop.channel, hop.frequency);
+            retune.hasQuickTune = (handle >= 0);
+            if (retune.hasQuickTune) retune.quickTune = _quickTunes[handle].quickTune;
+
+            //the bladeRF2 scheduled retune needs a fast lock profile, the FPGA would drop the hop
+            if (_isBladeRF2 and not retune.hasQuickTune)
+            {
+                SoapySDR::logf(SOAPY_SDR_ERROR, "scheduleHops() %f MHz has no saved quick tune", hop.frequency/1e6);
+                throw std::runtime_error("scheduleHops() frequency " + std::to_string(hop.frequency) + " has no saved quick tune");
+            }
+            retunes.push_back(retune);
+        }
+        if (not std::isnan(hop.gain)) gains.push_back(hop);
+    }
+
+    //the hop thread retunes later on, getFrequency() reads the device until the next setFrequency()
+    for (const auto &hop : hops)
+    {
+        if (not std::isnan(hop.frequency)) this->_uncacheFrequencies(hop.direction);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_hopMutex);
+        _hopRetunes.insert(_hopRetunes.end(), retunes.begin(), retunes.end());
+        _hopGains.insert(_hopGains.end(), gains.begin(), gains.end());
+        std::stable_sort(_hopRetunes.begin(), _hopRetunes.end(), [](const PendingRetune &a, const PendingRetune &b){return a.timeNs < b.timeNs;});
+        std::stable_sort(_hopGains.begin(), _hopGains.end(), [](const HopCommand &a, const HopCommand &b){return a.timeNs < b.timeNs;});
+        if (not _hopThread.joinable()) _hopThread = std::thread(&bladeRF_SoapySDR::hopLoop, this);
+    }
+    _hopCond.notify_one();
+}
+
+void bladeRF_SoapySDR::clearHops(void)
+{
+    std::lock_guard<std::mutex> lock(_hopMutex);
+    _hopRetunes.clear();
+    _hopGains.clear();
+    _hopGeneration++;
+}
+
+HopStatus bladeRF_SoapySDR::getHopStatus(void) const
+{
+    std::lock_guard<std::mutex> lock(_hopMutex);
+    HopStatus status = _hopStatus;
+    status.pending = _hopRetunes.size() + _hopGains.size();
+    return status;
+}
+
+bool bladeRF_SoapySDR::hopMissed(const int direction, const long long timeNs) const
+{
+    std::lock_guard<std::mutex> lock(_hopMutex);
+    for (const auto &failure : _hopFailures)
+    {
+        if (failure.first == direction and failure.second == timeNs) return true;
+    }
+
+    //the caller asks after the time of the hop, one that is still queued was not applied on time
+    for (const auto &retune : _hopRetunes)
+    {
+        if (retune.direction == direction and retune.timeNs == timeNs) return true;
+    }
+    for (const auto &hop : _hopGains)
+    {
+        if (hop.direction == direction and hop.timeNs == timeNs) return true;
+    }
+    return false;
+}
+
+void bladeRF_SoapySDR::recordHopFailure(const int direction, const long long timeNs, const std::string &what)
+{
+    SoapySDR::logf(SOAPY_SDR_ERROR, "hop at %lld ns dropped: %s", timeNs, what.c_str());
+    _hopStatus.failed++;
+    _hopStatus.lastFailedTimeNs = timeNs;
+    _hopStatus.lastError = what;
+    _hopFailures.emplace_back(direction, timeNs);
+    if (_hopFailures.size() > HOP_FAILURE_HISTORY) _hopFailures.pop_front();
+}
+
+void bladeRF_SoapySDR::hopLoop(void)
+{
+    _threadPolicy.apply("hop thread");
+    std::unique_lock<std::mutex> lock(_hopMutex);
+    while (not _hopDone)
+    {
+        if (_hopRetunes.empty() and _hopGains.empty())
+        {
+            _hopCond.wait(lock);
+            continue;
+        }
+
+        //device calls are made without the lock so scheduleHops() never waits on a USB transfer,
+        //the hardware time model makes this cheap, see getHardwareTime()
+        long long timeNow = 0;
+        bool timeValid = true;
+        lock.unlock();
+        try {timeNow = this->getHardwareTime();}
+        catch (const std::exception &) {timeValid = false;}
+        lock.lock();
+        if (not timeValid)
+        {
+            _hopCond.wait_for(lock, std::chrono::nanoseconds(HOP_RETRY_NS));
+            continue;
+        }
+        const auto clockNow = std::chrono::steady_clock::now();
+        bool hasWait = false;
+        auto waitTime = clockNow;
+        const auto waitUntil = [&](const long long timeNs)
+        {
+            const auto t = clockNow + std::chrono::nanoseconds(std::max(0LL, timeNs - timeNow));
+            waitTime = hasWait?std::min(waitTime, t):t;
+            hasWait = true;
+        };
+
+        //forget the retunes that the FPGA has applied
+        while (not _hopInFlight.empty() and _hopInFlight.front() <= timeNow) _hopInFlight.pop_front();
+
+        //feed the FPGA retune queue in time order until it is full
+        while (not _hopDone and not _hopRetunes.empty())
+        {
+            const PendingRetune retune = _hopRetunes.front();
+            _hopRetunes.pop_front();
+
+            //a retune handed over after its time would land in the middle of the next dwell
+            if (retune.timeNs != 0 and retune.timeNs < timeNow)
+            {
+                this->recordHopFailure(retune.direction, retune.timeNs, "retune is late");
+                continue;
+            }
+
+            const unsigned long long generation = _hopGeneration;
+            lock.unlock();
+            PendingRetune copy = retune;
+            const int ret = bladerf_schedule_retune(_dev, copy.ch, copy.ticks, copy.frequency, copy.hasQuickTune?&copy.quickTune:nullptr);
+            lock.lock();
+
+            if (ret == BLADERF_ERR_QUEUE_FULL)
+            {
+                //put it back unless clearHops() ran meanwhile, and retry once the earliest queued retune has been applied
+                if (generation == _hopGeneration)
+                {
+                    const auto pos = std::upper_bound(_hopRetunes.begin(), _hopRetunes.end(), retune,
+                        [](const PendingRetune &a, const PendingRetune &b){return a.timeNs < b.timeNs;});
+                    _hopRetunes.insert(pos, retune);
+                }
+                waitUntil(_hopInFlight.empty()?(timeNow + HOP_RETRY_NS):_hopInFlight.front());
+                break;
+            }
+            if (ret != 0) this->recordHopFailure(retune.direction, retune.timeNs, "bladerf_schedule_retune() returned " + _err2str(ret));
+            else
+            {
+                _hopInFlight.push_back(std::max(retune.timeNs, timeNow));
+                _hopStatus.retunes++;
+            }
+        }
+
+        //apply the gains that are due, there is no gain queue in the FPGA
+        while (not _hopDone and not _hopGains.empty() and _hopGains.front().timeNs <= timeNow)
+        {
+            const HopCommand hop = _hopGains.front();
+            _hopGains.pop_front();
+            std::string error;
+            lock.unlock();
+            try {this->setGain(hop.direction, hop.channel, hop.gain);}
+            catch (const std::exception &ex) {error = ex.what();}
+            lock.lock();
+            if (not error.empty()) this->recordHopFailure(hop.direction, hop.timeNs, "gain " + std::to_string(hop.gain) + " " + error);
+            else _hopStatus.gains++;
+        }
+        if (not _hopGains.empty()) waitUntil(_hopGains.front().timeNs);
+
+        //new hops and shutdown notify early
+        if (hasWait and not _hopDone) _hopCond.wait_until(lock, waitTime);
+    }
+}
+
 /*******************************************************************
  * Sample Rate API
  ******************************************************************/
@@ -587,7 +1211,9 @@ void bladeRF_SoapySDR::setSampleRate(const int direction, const size_t channel,
     //stash the approximate hardware time so it can be restored
     const long long timeNow = this->getHardwareTime();
 
+    //the bladeRF2 rx and tx share the rate
     int ret = bladerf_set_rational_sample_rate(_dev, _toch(direction, channel), &ratRate, NULL);
+    this->_forgetSettings(SETTING_SAMPLE_RATE, -1);
     if (ret != 0)
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_set_rational_sample_rate(%f) returned %s", rate, _err2str(ret).c_str());
@@ -599,7 +1225,6 @@ void bladeRF_SoapySDR::setSampleRate(const int direction, const size_t channel,
     if (direction == SOAPY_SDR_RX)
     {
         _rxSampRate = actual;
-        this->updateRxMinTimeoutMs();
     }
     if (direction == SOAPY_SDR_TX)
     {
@@ -614,6 +1239,11 @@ void bladeRF_SoapySDR::setSampleRate(const int direction, const size_t channel,
 
 double bladeRF_SoapySDR::getSampleRate(const int direction, const size_t channel) const
 {
+    const unsigned key = _settingKey(SETTING_SAMPLE_RATE, direction, channel);
+    double cached(0);
+    unsigned long long generation(0);
+    if (this->_getCachedSetting(key, cached, generation)) return cached;
+
     bladerf_rational_rate ratRate;
     int ret = bladerf_get_rational_sample_rate(_dev, _toch(direction, channel), &ratRate);
     if (ret != 0)
@@ -622,7 +1252,9 @@ double bladeRF_SoapySDR::getSampleRate(const int direction, const size_t channel
         throw std::runtime_error("getSampleRate() " + _err2str(ret));
     }
 
-    return double(ratRate.integer) + (double(ratRate.num)/double(ratRate.den));
+    const double rate = double(ratRate.integer) + (double(ratRate.num)/double(ratRate.den));
+    this->_cacheSetting(key, rate, generation);
+    return rate;
 }
 
 SoapySDR::RangeList bladeRF_SoapySDR::getSampleRateRange(const int direction, const size_t channel) const
@@ -665,6 +1297,9 @@ std::vector<double> bladeRF_SoapySDR::listSampleRates(const int direction, const
 
 void bladeRF_SoapySDR::setBandwidth(const int direction, const size_t channel, const double bw)
 {
+    //the channels of a direction share the filter on the bladeRF2
+    this->_forgetSettings(SETTING_BANDWIDTH, direction);
+
     //bypass the filter when sufficiently large BW is selected
     if (bw > this->getBandwidthRange(direction, channel).back().maximum())
     {
@@ -675,6 +1310,7 @@ void bladeRF_SoapySDR::setBandwidth(const int direction, const size_t channel, c
     //otherwise set to normal and configure the filter bandwidth
     bladerf_set_lpf_mode(_dev, _toch(direction, channel), BLADERF_LPF_NORMAL);
     int ret = bladerf_set_bandwidth(_dev, _toch(direction, channel), bladerf_bandwidth(std::round(bw)), NULL);
+    this->_forgetSettings(SETTING_BANDWIDTH, direction);
     if (ret != 0)
     {
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_set_bandwidth(%f) returned %s", bw, _err2str(ret).c_str());
@@ -684,6 +1320,11 @@ void bladeRF_SoapySDR::setBandwidth(const int direction, const size_t channel, c
 
 double bladeRF_SoapySDR::getBandwidth(const int direction, const size_t channel) const
 {
+    const unsigned key = _settingKey(SETTING_BANDWIDTH, direction, channel);
+    double cached(0);
+    unsigned long long generation(0);
+    if (this->_getCachedSetting(key, cached, generation)) return cached;
+
     bladerf_bandwidth bw(0);
     int ret = bladerf_get_bandwidth(_dev, _toch(direction, channel), &bw);
     if (ret != 0)
@@ -691,6 +1332,7 @@ double bladeRF_SoapySDR::getBandwidth(const int direction, const size_t channel)
         SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_get_bandwidth() returned %s", _err2str(ret).c_str());
         throw std::runtime_error("getBandwidth() " + _err2str(ret));
     }
+    this->_cacheSetting(key, double(bw), generation);
     return double(bw);
 }
 
@@ -826,8 +1468,20 @@ bool bladeRF_SoapySDR::hasHardwareTime(const std::string &what) const
 long long bladeRF_SoapySDR::getHardwareTime(const std::string &what) const
 {
     if (not what.empty()) return SoapySDR::Device::getHardwareTime(what);
+
+    //extrapolate from the clock model between hardware reads
+    std::unique_lock<std::mutex> lock(_clockMutex);
+    const auto timeNow = std::chrono::steady_clock::now();
+    if (_clockValid and timeNow - _clockSyncTime < std::chrono::milliseconds(_clockResyncMs))
+    {
+        return _rxTicksToTimeNs(_clockTicksAt(timeNow));
+    }
+
+    //the read happened about half way through the control transfer
     uint64_t ticksNow = 0;
+    const auto timeBefore = std::chrono::steady_clock::now();
     const int ret = bladerf_get_timestamp(_dev, BLADERF_RX, &ticksNow);
+    const auto timeAfter = std::chrono::steady_clock::now();
 
     if (ret != 0)
     {
@@ -835,9 +1489,35 @@ long long bladeRF_SoapySDR::getHardwareTime(const std::string &what) const
         throw std::runtime_error("getHardwareTime() " + _err2str(ret));
     }
 
+    //measure the drift between hardware reads, averaged to smooth out the USB latency jitter
+    const auto timeRead = timeBefore + (timeAfter - timeBefore)/2;
+    const double elapsed = std::chrono::duration<double>(timeRead - _clockSyncTime).count();
+    if (_clockValid and elapsed >= CLOCK_DRIFT_MIN_S)
+    {
+        const double drift = (double(ticksNow) - double(_clockSyncTicks))/(elapsed*_rxSampRate) - 1.0;
+        _clockDrift += (drift - _clockDrift)/8;
+    }
+
+    _clockSyncTicks = ticksNow;
+    _clockSyncTime = timeRead;
+    _clockTicks = ticksNow;
+    _clockTime = timeRead;
+    _clockValid = true;
+
     return _rxTicksToTimeNs(ticksNow);
 }
 
+void bladeRF_SoapySDR::observeRxTicks(const long long ticks)
+{
+    //a delivered sample was captured in the past, so it only ever moves the model forward
+    std::lock_guard<std::mutex> lock(_clockMutex);
+    if (not _clockValid) return;
+    const auto timeNow = std::chrono::steady_clock::now();
+    if (_clockTicksAt(timeNow) >= ticks) return;
+    _clockTicks = ticks;
+    _clockTime = timeNow;
+}
+
 void bladeRF_SoapySDR::setHardwareTime(const long long timeNs, const std::string &what)
 {
     if (not what.empty()) return SoapySDR::Device::setHardwareTime(timeNs, what);
@@ -859,6 +1539,8 @@ void bladeRF_SoapySDR::setHardwareTime(const long long timeNs, const std::string
     }
 
     _timeNsOffset = timeNs;
+    this->_invalidateClock();
+    this->invalidateTxClock();
 }
 
 /*******************************************************************
@@ -869,6 +1551,8 @@ std::vector<std::string> bladeRF_SoapySDR::listSensors(void) const
 {
     std::vector<std::string> sensors;
     if (_isBladeRF2) sensors.push_back("RFIC_TEMP");
+    sensors.push_back("CLOCK_DRIFT");
+    sensors.push_back("TELEMETRY");
     return sensors;
 }
 
@@ -885,11 +1569,35 @@ SoapySDR::ArgInfo bladeRF_SoapySDR::getSensorInfo(const std::string &key) const
         info.type = SoapySDR::ArgInfo::FLOAT;
         return info;
     }
+    else if (key == "CLOCK_DRIFT")
+    {
+        SoapySDR::ArgInfo info;
+        info.key = key;
+        info.value = "0";
+        info.name = "Clock Drift";
+        info.description = "Tick rate error of the hardware time against the host clock, measured between getHardwareTime() resyncs";
+        info.units = "ppm";
+        info.type = SoapySDR::ArgInfo::FLOAT;
+        return info;
+    }
+    else if (key == "TELEMETRY")
+    {
+        SoapySDR::ArgInfo info;
+        info.key = key;
+        info.value = "";
+        info.name = "Telemetry Snapshot";
+        info.description = "Every sensor, gain, and frequency as key=value pairs, see the telemetry_interval_ms setting";
+        info.type = SoapySDR::ArgInfo::STRING;
+        return info;
+    }
     else throw std::runtime_error("getSensorInfo(" + key + ") unknown sensor");
 }
 
 std::string bladeRF_SoapySDR::readSensor(const std::string &key) const
 {
+    std::string cached;
+    if (key == "RFIC_TEMP" and this->readTelemetry(key, cached)) return cached;
+
     if (key == "RFIC_TEMP")
     {
         float val(0);
@@ -901,6 +1609,15 @@ std::string bladeRF_SoapySDR::readSensor(const std::string &key) const
         }
         return std::to_string(val);
     }
+    else if (key == "CLOCK_DRIFT")
+    {
+        std::lock_guard<std::mutex> lock(_clockMutex);
+        return std::to_string(_clockDrift*1e6);
+    }
+    else if (key == "TELEMETRY")
+    {
+        return SoapySDR::KwargsToString(this->readSensorSnapshot());
+    }
     else throw std::runtime_error("readSensor(" + key + ") unknown sensor");
 }
 
@@ -909,6 +1626,7 @@ std::vector<std::string> bladeRF_SoapySDR::listSensors(const int direction, cons
     std::vector<std::string> sensors;
     if (_isBladeRF2 and direction == SOAPY_SDR_RX) sensors.push_back("PRE_RSSI");
     if (_isBladeRF2 and direction == SOAPY_SDR_RX) sensors.push_back("SYM_RSSI");
+    sensors.push_back("STREAM_STATS");
     return sensors;
 }
 
@@ -936,11 +1654,28 @@ SoapySDR::ArgInfo bladeRF_SoapySDR::getSensorInfo(const int direction, const siz
         info.type = SoapySDR::ArgInfo::FLOAT;
         return info;
     }
+    else if (key == "STREAM_STATS")
+    {
+        SoapySDR::ArgInfo info;
+        info.key = key;
+        info.value = "";
+        info.name = "Stream Statistics";
+        info.description = "Counters of the stream set up in this direction as key=value pairs:\n"
+            "samples, overflows, underflows, timeouts, time_errors, convert_us, blocked_us,\n"
+            "calls, latency_p50_us, latency_p99_us, and latency_hist_us (bin upper bound:count).\n"
+            "Empty when no stream is set up.";
+        info.type = SoapySDR::ArgInfo::STRING;
+        return info;
+    }
     else throw std::runtime_error("getSensorInfo(" + key + ") unknown sensor");
 }
 
 std::string bladeRF_SoapySDR::readSensor(const int direction, const size_t channel, const std::string &key) const
 {
+    std::string cached;
+    const std::string prefix = std::string((direction == SOAPY_SDR_RX)?"RX":"TX") + std::to_string(channel) + ":";
+    if ((key == "PRE_RSSI" or key == "SYM_RSSI") and this->readTelemetry(prefix + key, cached)) return cached;
+
     if (key == "PRE_RSSI" or key == "SYM_RSSI")
     {
         int32_t pre_rssi(0), sym_rssi(0);
@@ -952,9 +1687,196 @@ std::string bladeRF_SoapySDR::readSensor(const int direction, const size_t chann
         }
         return std::to_string((key[0] == 'P')?pre_rssi:sym_rssi);
     }
+    else if (key == "STREAM_STATS")
+    {
+        return this->readStreamStats(direction);
+    }
     else throw std::runtime_error("readSensor(" + key + ") unknown sensor");
 }
 
+/*******************************************************************
+ * Settings cache
+ ******************************************************************/
+
+bool bladeRF_SoapySDR::_getCachedSetting(const unsigned key, double &value, unsigned long long &generation) const
+{
+    std::lock_guard<std::mutex> lock(_settingsMutex);
+    generation = _settingsGeneration;
+    const auto it = _settingsCache.find(key);
+    if (it == _settingsCache.end() or std::isnan(it->second)) return false;
+    value = it->second;
+    return true;
+}
+
+void bladeRF_SoapySDR::_cacheSetting(const unsigned key, const double value, const unsigned long long generation) const
+{
+    //a setter that ran during the read may have made the value stale
+    std::lock_guard<std::mutex> lock(_settingsMutex);
+    if (generation != _settingsGeneration) return;
+    _settingsCache.emplace(key, value); //keeps a NAN entry
+}
+
+void bladeRF_SoapySDR::_forgetSettings(const SettingKind kind, const int direction)
+{
+    std::lock_guard<std::mutex> lock(_settingsMutex);
+    _settingsGeneration++;
+    for (auto it = _settingsCache.begin(); it != _settingsCache.end();)
+    {
+        const bool match = (it->first >> 8) == unsigned(kind) and
+            (direction == -1 or ((it->first & 0x80) != 0) == (direction == SOAPY_SDR_RX));
+        if (match) it = _settingsCache.erase(it);
+        else ++it;
+    }
+}
+
+void bladeRF_SoapySDR::_uncacheFrequencies(const int direction)
+{
+    const size_t numChans = this->getNumChannels(direction);
+    std::lock_guard<std::mutex> lock(_settingsMutex);
+    _settingsGeneration++;
+    for (size_t channel = 0; channel < numChans; channel++)
+    {
+        _settingsCache[_settingKey(SETTING_FREQUENCY, direction, channel)] = NAN;
+    }
+}
+
+void bladeRF_SoapySDR::_invalidateSettingsCache(void)
+{
+    std::lock_guard<std::mutex> lock(_settingsMutex);
+    _settingsGeneration++;
+    _settingsCache.clear();
+}
+
+/*******************************************************************
+ * Telemetry API
+ ******************************************************************/
+
+void bladeRF_SoapySDR::setTelemetryInterval(const long intervalMs)
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(_telemetryMutex);
+        _telemetryIntervalMs = intervalMs;
+        if (intervalMs > 0)
+        {
+            if (not _telemetryThread.joinable())
+            {
+                _telemetryDone = false;
+                _telemetryThread = std::thread(&bladeRF_SoapySDR::telemetryLoop, this);
+            }
+        }
+        else
+        {
+            _telemetryDone = true;
+            _telemetry.clear();
+            thread = std::move(_telemetryThread);
+        }
+    }
+    _telemetryCond.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+SoapySDR::Kwargs bladeRF_SoapySDR::readSensorSnapshot(void) const
+{
+    SoapySDR::Kwargs snapshot;
+    {
+        std::lock_guard<std::mutex> lock(_telemetryMutex);
+        if (_telemetryIntervalMs > 0 and not _telemetry.empty())
+        {
+            snapshot = _telemetry;
+            const auto age = std::chrono::steady_clock::now() - _telemetryTime;
+            snapshot["age_ms"] = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(age).count());
+        }
+    }
+
+    //no sampler or no sample yet, read it all now
+    if (snapshot.empty())
+    {
+        snapshot = this->sampleTelemetry();
+        snapshot["age_ms"] = "0";
+    }
+
+    snapshot["CLOCK_DRIFT"] = this->readSensor("CLOCK_DRIFT");
+    return snapshot;
+}
+
+SoapySDR::Kwargs bladeRF_SoapySDR::sampleTelemetry(void) const
+{
+    SoapySDR::Kwargs values;
+
+    //a failed read is left out of this sample, the next one tries again
+    const auto sample = [&](const std::string &key, const std::function<std::string(void)> &read)
+    {
+        try {values[key] = read();}
+        catch (const std::exception &ex)
+        {
+            SoapySDR::logf(SOAPY_SDR_DEBUG, "telemetry %s: %s", key.c_str(), ex.what());
+        }
+    };
+
+    if (_isBladeRF2) sample("RFIC_TEMP", [&](void)
+    {
+        float val(0);
+        const int ret = bladerf_get_rfic_temperature(_dev, &val);
+        if (ret != 0) throw std::runtime_error("bladerf_get_rfic_temperature() " + _err2str(ret));
+        return std::to_string(val);
+    });
+
+    for (const int direction : {SOAPY_SDR_RX, SOAPY_SDR_TX})
+    {
+        for (size_t channel = 0; channel < this->getNumChannels(direction); channel++)
+        {
+            const std::string prefix = std::string((direction == SOAPY_SDR_RX)?"RX":"TX") + std::to_string(channel) + ":";
+            if (_isBladeRF2 and direction == SOAPY_SDR_RX)
+            {
+                //one call returns both values
+                int32_t pre_rssi(0), sym_rssi(0);
+                const int ret = bladerf_get_rfic_rssi(_dev, _toch(direction, channel), &pre_rssi, &sym_rssi);
+                if (ret == 0)
+                {
+                    values[prefix + "PRE_RSSI"] = std::to_string(pre_rssi);
+                    values[prefix + "SYM_RSSI"] = std::to_string(sym_rssi);
+                }
+                else SoapySDR::logf(SOAPY_SDR_DEBUG, "telemetry %sRSSI: bladerf_get_rfic_rssi() %s", prefix.c_str(), _err2str(ret).c_str());
+            }
+            sample(prefix + "GAIN", [&](void){return std::to_string(this->getGain(direction, channel));});
+            sample(prefix + "FREQUENCY", [&](void){return std::to_string(this->getFrequency(direction, channel, "RF"));});
+        }
+    }
+
+    return values;
+}
+
+void bladeRF_SoapySDR::telemetryLoop(void)
+{
+    _threadPolicy.apply("telemetry thread");
+    std::unique_lock<std::mutex> lock(_telemetryMutex);
+    while (not _telemetryDone)
+    {
+        //the device calls are made without the lock so readers never wait on them
+        lock.unlock();
+        SoapySDR::Kwargs values = this->sampleTelemetry();
+        lock.lock();
+        if (_telemetryDone) break;
+
+        _telemetry.swap(values);
+        _telemetryTime = std::chrono::steady_clock::now();
+
+        //interval changes and shutdown notify early
+        _telemetryCond.wait_for(lock, std::chrono::milliseconds(_telemetryIntervalMs));
+    }
+}
+
+bool bladeRF_SoapySDR::readTelemetry(const std::string &key, std::string &value) const
+{
+    std::lock_guard<std::mutex> lock(_telemetryMutex);
+    if (_telemetryIntervalMs <= 0) return false;
+    const auto it = _telemetry.find(key);
+    if (it == _telemetry.end()) return false;
+    value = it->second;
+    return true;
+}
+
 /*******************************************************************
  * Register API
  ******************************************************************/
@@ -968,6 +1890,9 @@ std::vector<std::string> bladeRF_SoapySDR::listRegisterInterfaces(void) const
 
 void bladeRF_SoapySDR::writeRegister(const std::string &name, const unsigned addr, const unsigned value)
 {
+    //raw writes can change anything that is cached
+    this->_invalidateSettingsCache();
+
     if (name == "LMS")
     {
         const int ret = bladerf_lms_write(_dev, uint8_t(addr), uint8_t(value));
@@ -1016,6 +1941,65 @@ unsigned bladeRF_SoapySDR::readRegister(const std::string &name, const unsigned
     throw std::runtime_error("readRegister(" + name + ") unknown register interface");
 }
 
+void bladeRF_SoapySDR::writeRegisters(const std::string &name, const unsigned addr, const std::vector<unsigned> &value)
+{
+    std::vector<std::pair<unsigned, unsigned>> writes;
+    for (size_t i = 0; i < value.size(); i++) writes.emplace_back(addr+unsigned(i), value[i]);
+    this->writeRegisters(name, writes);
+}
+
+std::vector<unsigned> bladeRF_SoapySDR::readRegisters(const std::string &name, const unsigned addr, const size_t length) const
+{
+    std::vector<unsigned> addrs;
+    for (size_t i = 0; i < length; i++) addrs.push_back(addr+unsigned(i));
+    return this->readRegisters(name, addrs);
+}
+
+void bladeRF_SoapySDR::writeRegisters(const std::string &name, const std::vector<std::pair<unsigned, unsigned>> &writes)
+{
+    const bool lms = (name == "LMS");
+    if (not lms and name != "RFIC") throw std::runtime_error("writeRegisters(" + name + ") unknown register interface");
+    this->_invalidateSettingsCache();
+
+    for (size_t i = 0; i < writes.size(); i++)
+    {
+        const unsigned addr = writes[i].first;
+        const int ret = lms?
+            bladerf_lms_write(_dev, uint8_t(addr), uint8_t(writes[i].second)):
+            bladerf_set_rfic_register(_dev, uint16_t(addr), uint8_t(writes[i].second));
+        if (ret != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "%s(0x%x) returned %s after %d of %d writes",
+                lms?"bladerf_lms_write":"bladerf_set_rfic_register", addr, _err2str(ret).c_str(), int(i), int(writes.size()));
+            throw std::runtime_error("writeRegisters() " + _err2str(ret));
+        }
+    }
+}
+
+std::vector<unsigned> bladeRF_SoapySDR::readRegisters(const std::string &name, const std::vector<unsigned> &addrs) const
+{
+    const bool lms = (name == "LMS");
+    if (not lms and name != "RFIC") throw std::runtime_error("readRegisters(" + name + ") unknown register interface");
+
+    std::vector<unsigned> values;
+    values.reserve(addrs.size());
+    for (const auto addr : addrs)
+    {
+        uint8_t value = 0;
+        const int ret = lms?
+            bladerf_lms_read(_dev, uint8_t(addr), &value):
+            bladerf_get_rfic_register(_dev, uint16_t(addr), &value);
+        if (ret != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "%s(0x%x) returned %s",
+                lms?"bladerf_lms_read":"bladerf_get_rfic_register", addr, _err2str(ret).c_str());
+            throw std::runtime_error("readRegisters() " + _err2str(ret));
+        }
+        values.push_back(value);
+    }
+    return values;
+}
+
 /*******************************************************************
 * Settings API
 ******************************************************************/
@@ -1180,6 +2164,184 @@ SoapySDR::ArgInfoList bladeRF_SoapySDR::getSettingInfo(void) const
 
     setArgs.push_back(biasTeeRx);
 
+    // Hardware time resync
+    SoapySDR::ArgInfo resyncArg;
+    resyncArg.key = "clock_resync_ms";
+    resyncArg.value = std::to_string(DEF_CLOCK_RESYNC_MS);
+    resyncArg.name = "Clock Resync Period";
+    resyncArg.description = "getHardwareTime() extrapolates from the host clock and reads the device at most once per period. Use 0 to read the device on every call.";
+    resyncArg.units = "ms";
+    resyncArg.type = SoapySDR::ArgInfo::INT;
+
+    setArgs.push_back(resyncArg);
+
+    // Hop schedule
+    SoapySDR::ArgInfo hopArg;
+    hopArg.key = "hop_schedule";
+    hopArg.value = "";
+    hopArg.name = "Hop Schedule";
+    hopArg.description = "Queue a hop sequence, entries are separated by ';' as 'RX0,timeNs,frequency,gain'. "
+        "A time of 0 applies at once, empty frequency or gain fields are left unchanged. "
+        "Frequencies saved with saveQuickTune retune with their quick tune, on BladeRF2 every frequency needs one. "
+        "An empty value drops the pending hops. Reading returns the number of pending hops, see hop_status for failures.";
+    hopArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(hopArg);
+
+    SoapySDR::ArgInfo hopStatusArg;
+    hopStatusArg.key = "hop_status";
+    hopStatusArg.value = "";
+    hopStatusArg.name = "Hop Status";
+    hopStatusArg.description = "Read only: the pending hops, the retunes and gains applied, and the hops dropped "
+        "on an error or because they were late, with the time and error of the last dropped one.";
+    hopStatusArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(hopStatusArg);
+
+    // Quick tune cache
+    SoapySDR::ArgInfo saveTunesArg;
+    saveTunesArg.key = "save_quick_tunes";
+    saveTunesArg.value = "";
+    saveTunesArg.name = "Save quick tunes";
+    saveTunesArg.description = "Write the quick tunes saved with saveQuickTune to the provided file path. Only available on BladeRF2.";
+    saveTunesArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(saveTunesArg);
+
+    SoapySDR::ArgInfo loadTunesArg;
+    loadTunesArg.key = "load_quick_tunes";
+    loadTunesArg.value = "";
+    loadTunesArg.name = "Load quick tunes";
+    loadTunesArg.description = "Read quick tunes from the provided file path. The file must come from this device with the same FPGA and firmware, "
+        "and the FPGA must not have been reloaded or power cycled since it was saved, which cannot be checked. "
+        "Saving quick tunes is refused after a load until load_fpga or reset. Only available on BladeRF2.";
+    loadTunesArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(loadTunesArg);
+
+    SoapySDR::ArgInfo sweepArg;
+    sweepArg.key = "quick_tune_sweep";
+    sweepArg.value = "";
+    sweepArg.name = "Quick tune sweep";
+    sweepArg.description = "Save quick tunes for 'RX0,f0,f1,...' or a range 'RX0,start:stop:step' in Hz. "
+        "Reading returns the saved and skipped counts and the replaced profiles of the last sweep. "
+        "A re-saved frequency takes a new profile, the replaced one stays unused until load_fpga. Only available on BladeRF2.";
+    sweepArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(sweepArg);
+
+    SoapySDR::ArgInfo toleranceArg;
+    toleranceArg.key = "quick_tune_tolerance";
+    toleranceArg.value = std::to_string(DEF_QUICK_TUNE_TOLERANCE);
+    toleranceArg.name = "Quick tune tolerance";
+    toleranceArg.description = "Frequencies within this distance match the same saved quick tune.";
+    toleranceArg.units = "Hz";
+    toleranceArg.type = SoapySDR::ArgInfo::FLOAT;
+
+    setArgs.push_back(toleranceArg);
+
+    SoapySDR::ArgInfo handlesArg;
+    handlesArg.key = "quick_tunes";
+    handlesArg.value = "";
+    handlesArg.name = "Quick tunes";
+    handlesArg.description = "Read only list of the saved quick tunes as 'handle:RX0:frequency', "
+        "a handle retunes with setFrequency() and quickTuneHandle in the args.";
+    handlesArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(handlesArg);
+
+    // Device group
+    SoapySDR::ArgInfo groupArg;
+    groupArg.key = "group";
+    groupArg.value = "";
+    groupArg.name = "Device group";
+    groupArg.description = "Join the named group of devices in this process, an empty value leaves the group.";
+    groupArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(groupArg);
+
+    SoapySDR::ArgInfo groupClockArg;
+    groupClockArg.key = "group_clock";
+    groupClockArg.value = "";
+    groupClockArg.name = "Group clock source";
+    groupClockArg.description = "Set the clock source of every group member, use ref_in to share a reference clock.";
+    groupClockArg.type = SoapySDR::ArgInfo::STRING;
+    groupClockArg.options = this->listClockSources();
+
+    setArgs.push_back(groupClockArg);
+
+    SoapySDR::ArgInfo groupSyncArg;
+    groupSyncArg.key = "group_sync";
+    groupSyncArg.value = "";
+    groupSyncArg.name = "Group time sync";
+    groupSyncArg.description = "Fire the mini expansion trigger from this device and set the hardware time of every group member "
+        "to the provided time in nanoseconds at the trigger edge. The trigger pins of the members must be wired together.";
+    groupSyncArg.units = "ns";
+    groupSyncArg.type = SoapySDR::ArgInfo::INT;
+
+    setArgs.push_back(groupSyncArg);
+
+    // Thread placement
+    SoapySDR::ArgInfo affinityArg;
+    affinityArg.key = "cpu_affinity";
+    affinityArg.value = "";
+    affinityArg.name = "CPU Affinity";
+    affinityArg.description = "Pin the hop thread to cpus, as in '2,3' or '4-7'. This is also the default of the cpu_affinity stream arg.";
+    affinityArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(affinityArg);
+
+    SoapySDR::ArgInfo priorityArg;
+    priorityArg.key = "rt_priority";
+    priorityArg.value = "0";
+    priorityArg.name = "Realtime Priority";
+    priorityArg.description = "Run the hop thread with SCHED_FIFO at this priority, 0 keeps the default scheduler. "
+        "This is also the default of the rt_priority stream arg.";
+    priorityArg.type = SoapySDR::ArgInfo::INT;
+    priorityArg.range = SoapySDR::Range(0, 99);
+
+    setArgs.push_back(priorityArg);
+
+    SoapySDR::ArgInfo numaArg;
+    numaArg.key = "numa_node";
+    numaArg.value = "";
+    numaArg.name = "NUMA Node";
+    numaArg.description = "The default of the numa_node stream arg.";
+    numaArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(numaArg);
+
+    // Batched register and GPIO writes
+    SoapySDR::ArgInfo regWritesArg;
+    regWritesArg.key = "register_writes";
+    regWritesArg.value = "";
+    regWritesArg.name = "Register writes";
+    regWritesArg.description = "Write registers in order, as 'RFIC:addr=value,addr=value,...' or with the LMS interface. Numbers may be hex.";
+    regWritesArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(regWritesArg);
+
+    SoapySDR::ArgInfo gpioBurstArg;
+    gpioBurstArg.key = "gpio_burst";
+    gpioBurstArg.value = "";
+    gpioBurstArg.name = "GPIO burst";
+    gpioBurstArg.description = "Apply masked GPIO writes in order, as 'CONFIG:value/mask,value/mask,...' or with the EXPANSION bank. Numbers may be hex.";
+    gpioBurstArg.type = SoapySDR::ArgInfo::STRING;
+
+    setArgs.push_back(gpioBurstArg);
+
+    // Telemetry
+    SoapySDR::ArgInfo telemetryArg;
+    telemetryArg.key = "telemetry_interval_ms";
+    telemetryArg.value = "0";
+    telemetryArg.name = "Telemetry interval";
+    telemetryArg.description = "Sample the sensors, gains, and frequencies in the background at this period and serve readSensor() "
+        "and the TELEMETRY sensor from the cache. Use 0 to query the device on every read.";
+    telemetryArg.units = "ms";
+    telemetryArg.type = SoapySDR::ArgInfo::INT;
+
+    setArgs.push_back(telemetryArg);
+
     return setArgs;
 }
 
@@ -1215,14 +2377,87 @@ std::string bladeRF_SoapySDR::readSetting(const std::string &key) const
         return "false";
     } else if (key == "biastee_rx") {
         return "false";
+    } else if (key == "clock_resync_ms") {
+        return std::to_string(_clockResyncMs);
+    } else if (key == "save_quick_tunes") {
+        return "";
+    } else if (key == "load_quick_tunes") {
+        return "";
+    } else if (key == "quick_tune_sweep") {
+        std::string replaced;
+        for (const auto slot : _lastSweep.replaced) replaced += (replaced.empty()?"":" ") + std::to_string(slot);
+        return "saved=" + std::to_string(_lastSweep.saved.size()) +
+            ", skipped=" + std::to_string(_lastSweep.skipped.size()) +
+            ", replaced=" + replaced;
+    } else if (key == "quick_tune_tolerance") {
+        return std::to_string(_quickTuneTolerance);
+    } else if (key == "quick_tunes") {
+        std::string list;
+        for (size_t i = 0; i < _quickTunes.size(); i++)
+        {
+            const auto &entry = _quickTunes[i];
+            char buff[64];
+            std::snprintf(buff, sizeof(buff), "%d:%s%d:%.0f", int(i), (entry.direction == SOAPY_SDR_RX)?"RX":"TX", int(entry.channel), entry.frequency);
+            list += (list.empty()?"":" ") + std::string(buff);
+        }
+        return list;
+    } else if (key == "hop_schedule") {
+        std::lock_guard<std::mutex> lock(_hopMutex);
+        return std::to_string(_hopRetunes.size() + _hopGains.size());
+    } else if (key == "hop_status") {
+        const HopStatus status = this->getHopStatus();
+        return "pending=" + std::to_string(status.pending) +
+            ", retunes=" + std::to_string(status.retunes) +
+            ", gains=" + std::to_string(status.gains) +
+            ", failed=" + std::to_string(status.failed) +
+            ", last_failed_ns=" + std::to_string(status.lastFailedTimeNs) +
+            ", last_error=" + status.lastError;
+    } else if (key == "group") {
+        return _groupName;
+    } else if (key == "group_clock") {
+        return this->getClockSource();
+    } else if (key == "group_sync") {
+        return "";
+    } else if (key == "telemetry_interval_ms") {
+        std::lock_guard<std::mutex> lock(_telemetryMutex);
+        return std::to_string(_telemetryIntervalMs);
+    } else if (key == "register_writes") {
+        return "";
+    } else if (key == "gpio_burst") {
+        return "";
+    } else if (key == "cpu_affinity") {
+        return _threadPolicy.cpuList();
+    } else if (key == "rt_priority") {
+        return std::to_string(_threadPolicy.priority);
+    } else if (key == "numa_node") {
+        return (_threadPolicy.numaNode < 0)?"":std::to_string(_threadPolicy.numaNode);
     }
 
     SoapySDR_logf(SOAPY_SDR_WARNING, "Unknown setting '%s'", key.c_str());
     return "";
 }
 
+void bladeRF_SoapySDR::writeSettings(const SoapySDR::Kwargs &args)
+{
+    //settings that reset the device state first, then the others in the getSettingInfo() order
+    static const char *first[] = {"load_fpga", "reset"};
+    std::vector<std::string> keys;
+    for (const auto key : first) if (args.count(key) != 0) keys.push_back(key);
+    for (const auto &info : this->getSettingInfo())
+    {
+        if (args.count(info.key) == 0) continue;
+        if (std::find(keys.begin(), keys.end(), info.key) != keys.end()) continue;
+        keys.push_back(info.key);
+    }
+
+    for (const auto &key : keys) this->writeSetting(key, args.at(key));
+}
+
 void bladeRF_SoapySDR::writeSetting(const std::string &key, const std::string &value)
 {
+    //these reconfigure the front end behind the cached getter values
+    if (key == "xb200" or key == "sampling_mode" or key == "loopback") this->_invalidateSettingsCache();
+
     if (key == "xb200")
     {
         // Verify that a valid setting has arrived
@@ -1412,6 +2647,10 @@ void bladeRF_SoapySDR::writeSetting(const std::string &key, const std::string &v
         if (value == "true") {
             // --> Valid setting has arrived
             int ret = bladerf_device_reset(_dev);
+            this->_invalidateSyncConfigs();
+            this->_invalidateClock();
+            this->_invalidateSettingsCache();
+            this->_invalidateQuickTunes();
             if (ret != 0)
             {
                 SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_device_reset(%s) returned %s", value.c_str(),
@@ -1494,6 +2733,10 @@ void bladeRF_SoapySDR::writeSetting(const std::string &key, const std::string &v
     {
         if (!value.empty()) {
             int ret = bladerf_load_fpga(_dev, value.c_str());
+            this->_invalidateSyncConfigs();
+            this->_invalidateClock();
+            this->_invalidateSettingsCache();
+            this->_invalidateQuickTunes();
             if (ret != 0) {
                 SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_load_fpga(%s) returned %s", value.c_str(),
                                _err2str(ret).c_str());
@@ -1533,6 +2776,80 @@ void bladeRF_SoapySDR::writeSetting(const std::string &key, const std::string &v
             }
         }
     }
+    else if (key == "save_quick_tunes")
+    {
+        if (!value.empty()) this->saveQuickTunes(value);
+    }
+    else if (key == "load_quick_tunes")
+    {
+        if (!value.empty()) this->loadQuickTunes(value);
+    }
+    else if (key == "quick_tune_sweep")
+    {
+        int direction(0);
+        size_t channel(0);
+        const auto frequencies = parseFrequencyList(value, direction, channel);
+        size_t lastDecile = 0;
+        _lastSweep = this->sweepQuickTunes(direction, channel, frequencies, [&lastDecile](const size_t done, const size_t total)
+        {
+            const size_t decile = (10*done)/total;
+            if (decile == lastDecile) return;
+            lastDecile = decile;
+            SoapySDR::logf(SOAPY_SDR_INFO, "quick_tune_sweep %d/%d", int(done), int(total));
+        });
+    }
+    else if (key == "quick_tune_tolerance")
+    {
+        const double tolerance = std::stod(value);
+        if (not (tolerance > 0)) throw std::runtime_error("writeSetting(" + key + ") tolerance must be positive");
+        _quickTuneTolerance = tolerance;
+        this->reindexQuickTunes();
+    }
+    else if (key == "hop_schedule")
+    {
+        if (value.empty()) return this->clearHops();
+        this->scheduleHops(parseHops(value));
+    }
+    else if (key == "clock_resync_ms")
+    {
+        std::lock_guard<std::mutex> lock(_clockMutex);
+        _clockResyncMs = std::max(0L, std::atol(value.c_str()));
+    }
+    else if (key == "group")
+    {
+        this->joinGroup(value);
+    }
+    else if (key == "group_clock")
+    {
+        this->setGroupClockSource(value);
+    }
+    else if (key == "group_sync")
+    {
+        this->syncGroupTime(std::stoll(value));
+    }
+    else if (key == "telemetry_interval_ms")
+    {
+        this->setTelemetryInterval(std::max(0L, std::atol(value.c_str())));
+    }
+    else if (key == "register_writes")
+    {
+        std::string name;
+        const auto writes = parsePairs(value, '=', name);
+        this->writeRegisters(name, writes);
+    }
+    else if (key == "gpio_burst")
+    {
+        std::string bank;
+        const auto writes = parsePairs(value, '/', bank);
+        this->writeGPIOBurst(bank, writes);
+    }
+    else if (key == "cpu_affinity" or key == "rt_priority" or key == "numa_node")
+    {
+        //a running hop thread keeps its policy until the device is reopened
+        SoapySDR::Kwargs args;
+        args[key] = value;
+        _threadPolicy = ThreadPolicy::fromArgs(args, _threadPolicy);
+    }
     else
     {
         throw std::runtime_error("writeSetting(" + key + ") unknown setting");
@@ -1578,6 +2895,36 @@ void bladeRF_SoapySDR::writeGPIO(const std::string &bank, const unsigned value,
     return SoapySDR::Device::writeGPIO(bank, value, mask);
 }
 
+void bladeRF_SoapySDR::writeGPIOBurst(const std::string &bank, const std::vector<std::pair<unsigned, unsigned>> &writes)
+{
+    int ret = 0;
+    if (bank == "CONFIG")
+    {
+        //read once, then transfer only the writes that change the register
+        uint32_t value = 0;
+        ret = bladerf_config_gpio_read(_dev, &value);
+        for (const auto &write : writes)
+        {
+            if (ret != 0) break;
+            const uint32_t next = (value & ~write.second) | (write.first & write.second);
+            if (next == value) continue;
+            ret = bladerf_config_gpio_write(_dev, next);
+            value = next;
+        }
+    }
+    else if (bank == "EXPANSION")
+    {
+        for (const auto &write : writes)
+        {
+            ret = bladerf_expansion_gpio_masked_write(_dev, write.second, write.first);
+            if (ret != 0) break;
+        }
+    }
+    else throw std::runtime_error("writeGPIOBurst("+bank+") unknown bank name");
+
+    if (ret != 0) throw std::runtime_error("writeGPIOBurst("+bank+") " + _err2str(ret));
+}
+
 unsigned bladeRF_SoapySDR::readGPIO(const std::string &bank) const
 {
     uint32_t value = 0;
@@ -23,9 +23,22 @@
 
 #include <SoapySDR/Device.hpp>
 #include <SoapySDR/Time.hpp>
+#include "bladeRF_BufferPool.hpp"
+#include "bladeRF_ThreadPolicy.hpp"
+#include "bladeRF_RecordFile.hpp"
+#include "bladeRF_ReplayFile.hpp"
 #include <libbladeRF.h>
 #include <cstdio>
 #include <queue>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
 
 #if defined(LIBBLADERF_API_VERSION) && (LIBBLADERF_API_VERSION >= 0x02000000)
 #else
@@ -43,6 +56,499 @@ struct StreamMetadata
     int code;
 };
 
+/*!
+ * One entry of a hop schedule, see bladeRF_SoapySDR::scheduleHops().
+ * A frequency with a saved quick tune retunes with that quick tune.
+ */
+struct HopCommand
+{
+    int direction;
+    size_t channel;
+    long long timeNs; //hardware time, 0 for now
+    double frequency; //NAN leaves the frequency
+    double gain; //NAN leaves the gain
+};
+
+/*!
+ * Counters of the hop schedule, see bladeRF_SoapySDR::getHopStatus().
+ */
+struct HopStatus
+{
+    HopStatus(void):
+        pending(0),
+        retunes(0),
+        gains(0),
+        failed(0),
+        lastFailedTimeNs(0)
+    {
+        return;
+    }
+
+    size_t pending; //hops not applied or handed to the FPGA yet
+    unsigned long long retunes; //handed to the FPGA retune queue
+    unsigned long long gains; //applied by the hop thread
+    unsigned long long failed; //dropped on an error or because they were late
+    long long lastFailedTimeNs;
+    std::string lastError;
+};
+
+/*!
+ * The dwell that the samples of bladeRF_SoapySDR::readScan() belong to.
+ */
+struct ScanBlock
+{
+    size_t step; //index into the scan list
+    size_t sweep; //sweeps completed before this dwell
+    double frequency;
+    double gain; //NAN when the step leaves the gain
+    long long timeNs; //hardware time of the first sample of the dwell
+    size_t offset; //samples of the dwell delivered by earlier reads
+};
+
+/*!
+ * The outcome of bladeRF_SoapySDR::sweepQuickTunes().
+ */
+struct QuickTuneSweepResult
+{
+    std::vector<double> saved; //frequencies with a new quick tune
+    std::vector<double> skipped; //frequencies left out once the profiles ran out
+    std::vector<unsigned> replaced; //profile slots of re-saved frequencies, unused until the FPGA is reloaded
+};
+
+/*!
+ * The last sync configuration applied to libbladeRF for one direction.
+ * Streams with an identical configuration skip bladerf_sync_config(),
+ * and channels stay enabled while they are used by consecutive streams.
+ * Closing the owning stream disables its channels and forgets the configuration,
+ * unless it was set up with keep_enabled. Switching to or from a direct access
+ * stream always disables the channels first.
+ */
+struct SyncConfig
+{
+    SyncConfig(void):
+        valid(false),
+        direct(false),
+        layout(BLADERF_RX_X1),
+        format(BLADERF_FORMAT_SC16_Q11),
+        numBuffs(0),
+        buffSize(0),
+        numXfers(0)
+    {
+        return;
+    }
+
+    bool valid;
+    bool direct; //the channels were enabled for a direct access stream
+    bladerf_channel_layout layout;
+    bladerf_format format;
+    size_t numBuffs;
+    size_t buffSize;
+    size_t numXfers;
+    std::vector<size_t> enabled; //channels enabled for streaming
+};
+
+/*!
+ * State for a direct buffer access stream built on the libbladeRF async API.
+ * The transfer buffers are owned by libbladeRF and handed out by index,
+ * the ready and free queues are shared with the libbladeRF stream callback.
+ */
+struct AsyncStream
+{
+    AsyncStream(void):
+        layout(BLADERF_RX_X1),
+        stream(nullptr),
+        buffs(nullptr),
+        numBuffs(0),
+        numXfers(0),
+        buffSize(0),
+        elemBytes(0),
+        idleXfers(0),
+        done(false),
+        running(false),
+        overflow(false),
+        underflow(false),
+        status(0)
+    {
+        return;
+    }
+
+    bladerf_channel_layout layout;
+    struct bladerf_stream *stream;
+    void **buffs;
+    size_t numBuffs;
+    size_t numXfers;
+    size_t buffSize;
+    size_t elemBytes; //bytes per sample on the wire
+    ThreadPolicy policy; //of the thread in bladerf_stream()
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<size_t> ready; //rx: filled by hardware, tx: filled by caller
+    std::deque<size_t> free; //rx: available to hardware, tx: available to caller
+    size_t idleXfers; //tx transfers waiting on a buffer to submit
+    bool done;
+    bool running;
+    bool overflow;
+    bool underflow;
+    int status;
+};
+
+/*!
+ * A filled rx ring slot: the result of one bladerf_sync_rx() call
+ */
+struct RxSlot
+{
+    std::vector<int16_t> buff;
+    long long timestamp;
+    size_t numElems;
+    unsigned status;
+    int ret;
+};
+
+/*!
+ * A filled tx ring slot: one converted writeStream() call
+ */
+struct TxSlot
+{
+    std::vector<int16_t> buff;
+    long long timeNs;
+    size_t numElems;
+    int flags;
+};
+
+/*!
+ * Single-producer/single-consumer ring of sample buffers serviced by a thread.
+ * The producer only writes head and the consumer only writes tail,
+ * the mutex and condition variable are only used to sleep on an empty or full ring.
+ */
+template <typename SlotType>
+struct SampleRing
+{
+    SampleRing(const size_t numSlots, const size_t slotScalars):
+        slots(numSlots),
+        head(0),
+        tail(0),
+        offset(0),
+        done(false),
+        waiters(0)
+    {
+        for (auto &slot : slots) slot.buff.resize(slotScalars);
+    }
+
+    bool empty(void) const
+    {
+        return head.load() == tail.load();
+    }
+
+    bool full(void) const
+    {
+        return (head.load() + 1) % slots.size() == tail.load();
+    }
+
+    size_t size(void) const
+    {
+        return (head.load() + slots.size() - tail.load()) % slots.size();
+    }
+
+    //! Sleep until the predicate holds or the time expires, returns the predicate
+    template <typename Predicate>
+    bool waitUntil(const std::chrono::steady_clock::time_point &exitTime, Predicate pred)
+    {
+        if (pred()) return true;
+        std::unique_lock<std::mutex> lock(mutex);
+        waiters++;
+        const bool ready = cond.wait_until(lock, exitTime, pred);
+        waiters--;
+        return ready;
+    }
+
+    //! Wake the other side if it sleeps in waitUntil(), the tx ring has a sleeper on each side
+    void notify(void)
+    {
+        if (waiters.load() == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        cond.notify_all();
+    }
+
+    std::vector<SlotType> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    size_t offset; //consumer position within the tail slot
+    std::atomic<bool> done;
+    std::atomic<size_t> waiters; //threads sleeping in waitUntil()
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+typedef SampleRing<RxSlot> RxRing;
+typedef SampleRing<TxSlot> TxRing;
+
+/*!
+ * A recording rx stream: a thread receives the samples straight into
+ * the record file and readStream() only reports the progress.
+ */
+struct RxRecorder
+{
+    RxRecorder(RecordFile *file):
+        file(file),
+        done(false),
+        running(false),
+        status(0),
+        startTicks(-1),
+        maxSamples(0)
+    {
+        return;
+    }
+
+    ~RxRecorder(void)
+    {
+        delete file;
+    }
+
+    RecordFile *file;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond; //notified when the thread stops
+    std::atomic<bool> done;
+    bool running;
+    int status; //the error that stopped the thread
+    long long startTicks; //first sample of a timed activation, -1 for now
+    unsigned long long maxSamples; //end of a burst activation, 0 for continuous
+};
+
+/*!
+ * A replaying tx stream: a thread sends the mapped file as one burst
+ * and writeStream() is not used. Status is reported by readStreamStatus().
+ */
+struct TxReplay
+{
+    TxReplay(ReplayFile *file, const bool loop):
+        file(file),
+        loop(loop),
+        done(false),
+        flags(0),
+        timeNs(0)
+    {
+        return;
+    }
+
+    ~TxReplay(void)
+    {
+        delete file;
+    }
+
+    ReplayFile *file;
+    const bool loop; //wrap around at the end of the file
+    std::thread thread;
+    std::atomic<bool> done;
+    int flags; //of the activation, SOAPY_SDR_HAS_TIME starts the burst at timeNs
+    long long timeNs;
+};
+
+/*!
+ * A scanning rx stream: every dwell is a timed rx command that starts
+ * once the retune before it has settled. The retunes go through the hop
+ * schedule a few dwells ahead of the reader, so the FPGA retunes on time
+ * while the previous dwell is still being read.
+ */
+struct RxScan
+{
+    struct Step
+    {
+        double frequency;
+        double gain; //NAN leaves the gain
+    };
+
+    struct Dwell
+    {
+        ScanBlock block;
+        long long retuneNs; //of the frequency retune the dwell relies on, 0 for none
+        long long gainNs; //of the gain hop of the dwell, 0 for none
+    };
+
+    RxScan(void):
+        dwell(0),
+        settle(0),
+        loop(true),
+        scheduled(0),
+        nextTicks(0),
+        tunedFrequency(0),
+        tunedNs(0),
+        offset(0)
+    {
+        return;
+    }
+
+    std::vector<Step> steps;
+    size_t dwell; //samples delivered per step
+    size_t settle; //samples skipped after each retune
+    bool loop; //sweep until deactivated
+
+    unsigned long long scheduled; //dwells handed to the hop schedule and the rx commands
+    long long nextTicks; //rx ticks of the next retune
+    double tunedFrequency; //of the last scheduled retune
+    long long tunedNs; //time of the last scheduled retune
+    std::deque<Dwell> pending; //dwells with rx commands, in order
+    size_t offset; //samples of the front dwell delivered
+};
+
+//! Number of power of two latency histogram bins, the last bin holds everything slower
+#define STREAM_LATENCY_BINS 24
+
+/*!
+ * Running counters for a stream, updated by the caller and the ring threads.
+ * Times are in nanoseconds, latency bin i counts calls that took
+ * less than 2^(i+1) microseconds (and at least 2^i for i > 0).
+ */
+struct StreamStats
+{
+    StreamStats(void):
+        samples(0),
+        overflows(0),
+        underflows(0),
+        timeouts(0),
+        timeErrors(0),
+        calls(0),
+        convertNs(0),
+        blockedNs(0)
+    {
+        for (auto &bin : latency) bin = 0;
+    }
+
+    void addLatency(const unsigned long long ns)
+    {
+        size_t bin = 0;
+        for (unsigned long long us = ns/2000; us != 0 and bin < STREAM_LATENCY_BINS-1; us >>= 1) bin++;
+        latency[bin]++;
+        calls++;
+    }
+
+    std::atomic<unsigned long long> samples;
+    std::atomic<unsigned long long> overflows;
+    std::atomic<unsigned long long> underflows;
+    std::atomic<unsigned long long> timeouts;
+    std::atomic<unsigned long long> timeErrors;
+    std::atomic<unsigned long long> calls;
+    std::atomic<unsigned long long> convertNs; //time spent converting samples
+    std::atomic<unsigned long long> blockedNs; //time spent in bladerf_sync_rx/tx() or waiting on a ring
+    std::atomic<unsigned long long> latency[STREAM_LATENCY_BINS]; //readStream/writeStream durations
+};
+
+/*!
+ * The state behind a SoapySDR::Stream handle returned by setupStream().
+ * Several streams may be set up per direction, but libbladeRF only holds
+ * one sync configuration per direction: the configuration of a stream is
+ * re-applied when it is activated after another stream of its direction.
+ */
+struct StreamState
+{
+    StreamState(const int direction):
+        direction(direction),
+        layout(BLADERF_RX_X1),
+        syncFormat(BLADERF_FORMAT_SC16_Q11),
+        numBuffs(0),
+        buffSize(0),
+        numXfers(0),
+        floats(false),
+        cs8(false),
+        wire8(false),
+        lowLatency(false),
+        keepEnabled(false),
+        convBuff(nullptr),
+        pool(nullptr),
+        active(false),
+        overflow(false),
+        inBurst(false),
+        nextTicks(0),
+        heldElems(0),
+        heldOffset(0),
+        heldTicks(0),
+        clockValid(false),
+        clockTimeNs(0),
+        async(nullptr),
+        rxRing(nullptr),
+        txRing(nullptr),
+        txRingLead(0),
+        recorder(nullptr),
+        replay(nullptr),
+        scan(nullptr)
+    {
+        return;
+    }
+
+    ~StreamState(void)
+    {
+        delete async;
+        delete rxRing;
+        delete txRing;
+        delete recorder;
+        delete replay;
+        delete scan;
+        if (pool != nullptr) pool->release(convBuff);
+    }
+
+    //! Bytes of one sample across all channels in the wire format
+    size_t elemBytes(void) const
+    {
+        return (wire8?2:4)*chans.size();
+    }
+
+    //! Bytes of one sample in a caller buffer of the stream format
+    size_t formatBytes(void) const
+    {
+        return floats?8:(cs8?2:4);
+    }
+
+    int direction;
+    std::vector<size_t> chans;
+
+    //sync configuration
+    bladerf_channel_layout layout;
+    bladerf_format syncFormat;
+    size_t numBuffs;
+    size_t buffSize;
+    size_t numXfers;
+
+    //caller and wire formats
+    bool floats;
+    bool cs8;
+    bool wire8;
+    bool lowLatency; //rx: one transfer per read and no timeout floor
+    bool keepEnabled; //rx: leave the channels enabled and the configuration cached at close
+    int16_t *convBuff;
+    BufferPool *pool; //owner of convBuff
+
+    bool active;
+    bool overflow; //rx: report an overflow on the next read
+    bool inBurst; //tx: a burst was started and not ended
+    long long nextTicks; //rx: after the last read, tx: after the last write
+    size_t heldElems; //rx: samples in convBuff received after a gap, delivered after the overflow
+    size_t heldOffset; //rx: samples of the held chunk already delivered
+    long long heldTicks; //rx: of the next held sample
+    std::queue<StreamMetadata> cmds; //rx commands from activateStream()
+    std::mutex respsMutex;
+    std::condition_variable respsCond; //notified on every pushed response
+    std::queue<StreamMetadata> resps; //tx responses for readStreamStatus()
+
+    //tx: hardware time at a host clock instant, burst ends expire on this clock
+    std::atomic<bool> clockValid;
+    long long clockTimeNs;
+    std::chrono::steady_clock::time_point clockTime;
+
+    AsyncStream *async; //direct buffer access mode
+    RxRing *rxRing; //reader thread mode
+    TxRing *txRing; //writer thread mode
+    size_t txRingLead;
+    ThreadPolicy policy; //ring threads, libbladeRF workers, and buffers
+    RxRecorder *recorder; //record to file mode
+    TxReplay *replay; //replay from file mode
+    RxScan *scan; //scanning mode
+
+    StreamStats stats;
+};
+
 /*!
  * The SoapySDR device interface for a blade RF.
  * The overloaded virtual methods calls into the blade RF C API.
@@ -51,8 +557,12 @@ class bladeRF_SoapySDR : public SoapySDR::Device
 {
 public:
 
-    //! initialize blade RF from device info
-    bladeRF_SoapySDR(const bladerf_devinfo &devinfo);
+    /*!
+     * initialize blade RF from device info
+     * \param fastOpen adopt the sample rates the device has instead of setting
+     * them and restoring the hardware time, which saves several control transfers
+     */
+    bladeRF_SoapySDR(const bladerf_devinfo &devinfo, const bool fastOpen = false);
 
     //! destructor shuts down and cleans up
     ~bladeRF_SoapySDR(void);
@@ -116,6 +626,23 @@ public:
         long long &timeNs,
         const long timeoutUs = 100000);
 
+    /*!
+     * Read a scan stream (setupStream "scan") and tag the samples with their dwell.
+     * A read never crosses dwells, the last read of a dwell has SOAPY_SDR_END_BURST.
+     * A dwell that loses samples is dropped and the read returns SOAPY_SDR_OVERFLOW.
+     * A dwell whose retune or gain hop was dropped is dropped and the read returns
+     * SOAPY_SDR_CORRUPTION with the block of the dwell, its samples were not taken
+     * at the tagged frequency or gain.
+     * readStream() delivers the same samples without the tags.
+     */
+    int readScan(
+        SoapySDR::Stream *stream,
+        void * const *buffs,
+        const size_t numElems,
+        int &flags,
+        ScanBlock &block,
+        const long timeoutUs = 100000);
+
     int writeStream(
         SoapySDR::Stream *stream,
         const void * const *buffs,
@@ -132,6 +659,39 @@ public:
         const long timeoutUs
     );
 
+    /*******************************************************************
+     * Direct buffer access API
+     ******************************************************************/
+
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream);
+
+    int getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs);
+
+    int acquireReadBuffer(
+        SoapySDR::Stream *stream,
+        size_t &handle,
+        const void **buffs,
+        int &flags,
+        long long &timeNs,
+        const long timeoutUs = 100000);
+
+    void releaseReadBuffer(
+        SoapySDR::Stream *stream,
+        const size_t handle);
+
+    int acquireWriteBuffer(
+        SoapySDR::Stream *stream,
+        size_t &handle,
+        void **buffs,
+        const long timeoutUs = 100000);
+
+    void releaseWriteBuffer(
+        SoapySDR::Stream *stream,
+        const size_t handle,
+        const size_t numElems,
+        int &flags,
+        const long long timeNs = 0);
+
     /*******************************************************************
      * Antenna API
      ******************************************************************/
@@ -194,6 +754,57 @@ public:
 
     SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel, const std::string &name) const;
 
+    /*!
+     * Queue a whole hop sequence in one call.
+     * Retunes are fed to the FPGA retune queue as it has room,
+     * timed gain changes are applied by the host on the hardware time model.
+     * On BladeRF2 every frequency needs a saved quick tune, otherwise this throws.
+     * Hops that fail later, or that are still waiting for the FPGA queue when
+     * their time has passed, are dropped and counted in getHopStatus().
+     */
+    void scheduleHops(const std::vector<HopCommand> &hops);
+
+    //! Drop the hops that were not handed to the FPGA yet
+    void clearHops(void);
+
+    //! The hop counters and the last failure
+    HopStatus getHopStatus(void) const;
+
+    /*!
+     * Write the saved quick tunes to a binary file keyed by the serial and
+     * the FPGA and firmware versions. Only available on BladeRF2.
+     */
+    void saveQuickTunes(const std::string &path) const;
+
+    /*!
+     * Read quick tunes written by saveQuickTunes(), replacing the saved ones
+     * at the same frequencies. Throws when the file belongs to another device
+     * or version, or when quick tunes were saved already since the FPGA was loaded.
+     * The profiles live in FPGA memory, so the file is only valid while the
+     * FPGA load that produced it stays up: a power cycle or an FPGA load by
+     * another process cannot be detected and leaves the handles retuning wrong.
+     * libbladeRF numbers new profiles from 0 again after bladerf_open(), so
+     * saving quick tunes is refused after a load until load_fpga or reset.
+     * \return the number of quick tunes loaded
+     */
+    size_t loadQuickTunes(const std::string &path);
+
+    //! The handle of the saved quick tune near a frequency for setFrequency() "quickTuneHandle", or -1
+    long getQuickTuneHandle(const int direction, const size_t channel, const double frequency) const;
+
+    /*!
+     * Save a quick tune for every frequency of a list on one channel.
+     * Stops saving once the NUM_BBP_FASTLOCK_PROFILES profiles are used,
+     * and restores the frequency that was tuned before the sweep.
+     * Only available on BladeRF2.
+     * \param progress called after each frequency with the count done and the total
+     */
+    QuickTuneSweepResult sweepQuickTunes(
+        const int direction,
+        const size_t channel,
+        const std::vector<double> &frequencies,
+        const std::function<void(const size_t, const size_t)> &progress = nullptr);
+
     /*******************************************************************
      * Sample Rate API
      ******************************************************************/
@@ -244,6 +855,54 @@ public:
 
     void setHardwareTime(const long long timeNs, const std::string &what = "");
 
+    /*******************************************************************
+     * Device group API
+     ******************************************************************/
+
+    /*!
+     * Join a named group of devices opened in this process,
+     * leaving the previous group. An empty name leaves the group.
+     * Members are listed in the order they joined.
+     */
+    void joinGroup(const std::string &name);
+
+    //! Set the clock source of every member, "ref_in" locks each PLL to a shared reference
+    void setGroupClockSource(const std::string &source);
+
+    /*!
+     * Align the hardware time of every member of the group.
+     * The rx samples of all members are gated on the mini expansion trigger,
+     * this device drives the trigger line and the others listen to it.
+     * The first sample after the trigger edge is given timeNs on every member.
+     * Setting the sample rate or the hardware time of a member afterwards
+     * breaks the alignment. Throws when a member streams rx or has another rx rate.
+     */
+    void syncGroupTime(const long long timeNs);
+
+    /*!
+     * Setup one stream on every member with the same arguments.
+     * \return the streams in member order
+     */
+    std::vector<SoapySDR::Stream *> setupGroupStreams(
+        const int direction,
+        const std::string &format,
+        const std::vector<size_t> &channels = std::vector<size_t>(),
+        const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    /*!
+     * Activate the streams of setupGroupStreams() together.
+     * Rx streams start at the same hardware time on every member,
+     * a timeNs of 0 starts shortly after the current hardware time.
+     * \return 0 or the first error code of a member
+     */
+    int activateGroupStreams(const std::vector<SoapySDR::Stream *> &streams, const long long timeNs = 0, const size_t numElems = 0);
+
+    //! Deactivate the streams of setupGroupStreams()
+    int deactivateGroupStreams(const std::vector<SoapySDR::Stream *> &streams);
+
+    //! Close the streams of setupGroupStreams()
+    void closeGroupStreams(const std::vector<SoapySDR::Stream *> &streams);
+
     /*******************************************************************
      * Sensor API
      ******************************************************************/
@@ -260,6 +919,22 @@ public:
 
     std::string readSensor(const int direction, const size_t channel, const std::string &key) const;
 
+    /*!
+     * Sample the sensors, gains, and frequencies from a background thread.
+     * While it runs, readSensor() returns the cached RFIC_TEMP, PRE_RSSI,
+     * and SYM_RSSI values instead of querying the device.
+     * \param intervalMs the sampling period, 0 stops the sampler
+     */
+    void setTelemetryInterval(const long intervalMs);
+
+    /*!
+     * All sensor, gain, and frequency values in one call, keyed as
+     * "RFIC_TEMP", "RX0:PRE_RSSI", "TX1:GAIN", "RX0:FREQUENCY", ...
+     * The values come from the sampler cache with their age in "age_ms",
+     * they are read from the device when the sampler is off.
+     */
+    SoapySDR::Kwargs readSensorSnapshot(void) const;
+
     /*******************************************************************
      * Register API
      ******************************************************************/
@@ -269,6 +944,20 @@ public:
 
     unsigned readRegister(const std::string &name, const unsigned addr) const;
 
+    void writeRegisters(const std::string &name, const unsigned addr, const std::vector<unsigned> &value);
+
+    std::vector<unsigned> readRegisters(const std::string &name, const unsigned addr, const size_t length) const;
+
+    /*!
+     * Write (address, value) pairs in order with one interface lookup.
+     * libbladeRF has no multi-register transfer, so each write is still one
+     * transfer. Throws at the first failed write, the earlier ones stay applied.
+     */
+    void writeRegisters(const std::string &name, const std::vector<std::pair<unsigned, unsigned>> &writes);
+
+    //! Read a list of addresses with one interface lookup
+    std::vector<unsigned> readRegisters(const std::string &name, const std::vector<unsigned> &addrs) const;
+
     /*******************************************************************
      * Settings API
      ******************************************************************/
@@ -279,6 +968,13 @@ public:
 
     std::string readSetting(const std::string &key) const;
 
+    /*!
+     * Apply every known setting found in args in one pass.
+     * Settings that reload the device (load_fpga, reset) go first so they
+     * do not undo the others, unknown keys are ignored.
+     */
+    void writeSettings(const SoapySDR::Kwargs &args);
+
     /*******************************************************************
      * GPIO API
      ******************************************************************/
@@ -291,6 +987,13 @@ public:
 
     unsigned readGPIO(const std::string &bank) const;
 
+    /*!
+     * Apply (value, mask) writes to a bank in order.
+     * The CONFIG bank is read once for the whole burst and only the writes
+     * that change it are transferred, EXPANSION writes are masked in hardware.
+     */
+    void writeGPIOBurst(const std::string &bank, const std::vector<std::pair<unsigned, unsigned>> &writes);
+
     void writeGPIODir(const std::string &bank, const unsigned dir);
 
     void writeGPIODir(const std::string &bank, const unsigned dir, const unsigned mask);
@@ -350,32 +1053,168 @@ private:
         return SoapySDR::timeNsToTicks(timeNs-_timeNsOffset, _txSampRate);
     }
 
-    void updateRxMinTimeoutMs(void)
+    //! The minimum rx timeout to receive one buffer
+    long _rxMinTimeoutMs(const StreamState *state) const
     {
         //the 2x factor allows padding so we aren't on the fence
-        _rxMinTimeoutMs = long((2*1000*_rxBuffSize)/_rxSampRate);
+        return long((2*1000*state->buffSize)/_rxSampRate);
     }
 
+    //! Pick the buffer count, buffer length, and transfer count from the sample rate, layout, latency target, and USB speed
+    void autoStreamBuffers(
+        const int direction,
+        const size_t numChans,
+        const bool wire8,
+        const long latencyUs,
+        int &numBuffs,
+        int &bufSize,
+        int &numXfers) const;
+
+    //! Apply the sync configuration and enable the channels of a stream when it is not already applied
+    void applyStreamConfig(StreamState *state);
+
+    //! Disable the streaming channels and forget the sync configuration of a direction
+    void releaseStreamConfig(const int direction);
+
+    //! Forget the applied sync configurations after the device state was lost
+    void _invalidateSyncConfigs(void)
+    {
+        _rxSyncConfig = SyncConfig();
+        _txSyncConfig = SyncConfig();
+    }
+
+    //! Rx ticks at a host clock instant extrapolated from the clock model, call with _clockMutex held
+    long long _clockTicksAt(const std::chrono::steady_clock::time_point &time) const
+    {
+        const double elapsed = std::chrono::duration<double>(time - _clockTime).count();
+        return _clockTicks + (long long)(elapsed*_rxSampRate*(1.0 + _clockDrift));
+    }
+
+    //! Forget the clock model after the tick counter or rate changed, the drift estimate is kept
+    void _invalidateClock(void)
+    {
+        std::lock_guard<std::mutex> lock(_clockMutex);
+        _clockValid = false;
+    }
+
+    //! Move the clock model forward to rx ticks that were delivered in stream metadata
+    void observeRxTicks(const long long ticks);
+
+    //! Start the reader thread that fills the rx ring
+    void startRxRing(StreamState *state);
+
+    //! Stop the reader thread and discard the ring contents
+    void stopRxRing(StreamState *state);
+
+    //! The rx ring reader thread loop
+    void rxRingLoop(StreamState *state);
+
+    //! readStream() implementation with bladerf_sync_rx() calls
+    int readStreamSync(StreamState *state, void * const *buffs, size_t numElems, int &flags, long long &timeNs, const long timeoutUs);
+
+    //! readStream() implementation when the reader thread is enabled
+    int readStreamRing(StreamState *state, void * const *buffs, size_t numElems, int &flags, long long &timeNs, const long timeoutUs);
+
+    //! Convert or copy raw rx samples into the caller's buffers
+    void convertRxSamples(StreamState *state, const void *in, void * const *buffs, const size_t numElems);
+
+    //! Start the thread that records rx samples to the file
+    void startRecorder(StreamState *state, const int flags, const long long timeNs, const size_t numElems);
+
+    //! Stop the record thread, the file stays open for the next activation
+    void stopRecorder(StreamState *state);
+
+    //! The record thread loop
+    void recordLoop(StreamState *state);
+
+    //! readStream() implementation when recording: waits for the recording to end
+    int readStreamRecord(StreamState *state, int &flags, const long timeoutUs);
+
+    //! Reset the scan and queue the first dwells, a timed activation starts the first retune at timeNs
+    void startScan(StreamState *state, const int flags, const long long timeNs);
+
+    //! Queue retunes and rx commands until the lookahead is full
+    void refillScan(StreamState *state);
+
+    //! Drop the queued dwells and the retunes that the FPGA has not applied
+    void stopScan(StreamState *state);
+
+    //! readStream() implementation when scanning, the block is filled when not null
+    int readStreamScan(StreamState *state, void * const *buffs, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs, ScanBlock *block);
+
+    //! Start the thread that sends the replay file
+    void startReplay(StreamState *state, const int flags, const long long timeNs);
+
+    //! Stop the replay thread, deactivateStream() ends the burst
+    void stopReplay(StreamState *state);
+
+    //! The replay thread loop
+    void replayLoop(StreamState *state);
+
+    //! Start the writer thread that drains the tx ring
+    void startTxRing(StreamState *state);
+
+    //! Drain the tx ring and stop the writer thread
+    void stopTxRing(StreamState *state);
+
+    //! The tx ring writer thread loop
+    void txRingLoop(StreamState *state);
+
+    //! writeStream() implementation with bladerf_sync_tx() calls
+    int writeStreamSync(StreamState *state, const void * const *buffs, size_t numElems, int &flags, const long long timeNs, const long timeoutUs);
+
+    //! writeStream() implementation when the writer thread is enabled
+    int writeStreamRing(StreamState *state, const void * const *buffs, size_t numElems, int &flags, const long long timeNs, const long timeoutUs);
+
+    //! Convert the caller's tx buffers into raw samples, returns the buffer to send
+    const void *convertTxSamples(StreamState *state, const void * const *buffs, void *out, const size_t numElems);
+
+    //! Apply the burst metadata and send raw tx samples, updates the burst state and status queue
+    int sendTxSamples(StreamState *state, const void *samples, const size_t numElems, const int flags, const long long timeNs, const long timeoutMs);
+
+    //! Push a tx status response for readStreamStatus()
+    void pushTxResp(StreamState *state, const StreamMetadata &resp);
+
+    //! Host clock instant at which the hardware time reaches timeNs, on the stream's local clock
+    std::chrono::steady_clock::time_point txTimeNsToClock(StreamState *state, const long long timeNs) const;
+
+    //! Forget the local clock of the tx stream after the hardware time or rate changed
+    void invalidateTxClock(void);
+
+    //! Count the caller visible result of a read or write
+    void countStreamResult(StreamState *state, const int ret);
+
+    //! Format the counters of the stream that holds the configuration of a direction
+    std::string readStreamStats(const int direction) const;
+
+    //! Start the async stream thread for direct buffer access
+    void startAsyncStream(AsyncStream *async);
+
+    //! Shutdown the async stream thread and release the libbladeRF buffers
+    void stopAsyncStream(AsyncStream *async);
+
     bool _isBladeRF1;
     bool _isBladeRF2;
     double _rxSampRate;
     double _txSampRate;
-    bool _inTxBurst;
-    bool _rxFloats;
-    bool _txFloats;
-    bool _rxOverflow;
-    long long _rxNextTicks;
-    long long _txNextTicks;
     long long _timeNsOffset;
-    int16_t *_rxConvBuff;
-    int16_t *_txConvBuff;
-    size_t _rxBuffSize;
-    size_t _txBuffSize;
-    std::vector<size_t> _rxChans;
-    std::vector<size_t> _txChans;
-    long _rxMinTimeoutMs;
-    std::queue<StreamMetadata> _rxCmds;
-    std::queue<StreamMetadata> _txResps;
+    StreamState *_rxSyncStream; //the stream whose configuration is applied
+    StreamState *_txSyncStream;
+    mutable std::mutex _syncStreamMutex; //protects the sync stream pointers for readStreamStats()
+    SyncConfig _rxSyncConfig; //what libbladeRF currently holds
+    SyncConfig _txSyncConfig;
+    BufferPool _buffPool; //conversion buffers reused across streams
+    ThreadPolicy _threadPolicy; //hop thread, and the defaults of the stream args
+
+    //hardware time model extrapolated from the host clock, see getHardwareTime()
+    mutable std::mutex _clockMutex;
+    mutable bool _clockValid;
+    mutable long long _clockTicks; //rx ticks at _clockTime
+    mutable std::chrono::steady_clock::time_point _clockTime;
+    mutable long long _clockSyncTicks; //rx ticks of the last hardware read
+    mutable std::chrono::steady_clock::time_point _clockSyncTime;
+    mutable double _clockDrift; //fractional tick rate error against the host clock
+    long _clockResyncMs; //0 reads the hardware on every call
     std::string _xb200Mode;
     std::string _samplingMode;
     std::string _loopbackMode;
@@ -383,20 +1222,173 @@ private:
     bladerf *_dev;
 
     /*!
-     * Will contain a list containing the info on the already computed quick tunes.
-     * The key is (direction, channel, frequency), as defined in setFrequency(direction, channel, name, frequency, args).
-     * The value is the computed bladerf_quick_tune.
+     * The saved quick tunes by value, the index is the quick tune handle.
      * It is filled when calling setFrequency(direction, channel, name, frequency, args)
-     * with "saveQuickTune" in the args.
+     * with "saveQuickTune" in the args, by sweepQuickTunes(), and by loadQuickTunes().
+     * Saving a frequency that is already in the table replaces it under the same handle.
      */
-    std::map<std::tuple<int, size_t, double>, bladerf_quick_tune*> _quickTunesByDirChanAndFreq;
+    struct QuickTuneEntry
+    {
+        int direction;
+        size_t channel;
+        double frequency;
+        bladerf_quick_tune quickTune;
+    };
+    std::vector<QuickTuneEntry> _quickTunes;
+
+    //! Handles by (direction, channel, frequency snapped to the tolerance), see _quickTuneKey()
+    std::unordered_map<unsigned long long, std::vector<size_t>> _quickTuneIndex;
+    double _quickTuneTolerance; //Hz
+
+    static unsigned long long _quickTuneKey(const int direction, const size_t channel, const long long bucket)
+    {
+        return (static_cast<unsigned long long>(bucket) << 8) | ((direction == SOAPY_SDR_RX)?0x80:0) | (channel & 0x7f);
+    }
+
+    //! The handle of the closest quick tune within the tolerance of a frequency, or -1
+    long findQuickTune(const int direction, const size_t channel, const double frequency) const;
+
+    //! Add or replace a quick tune in the table and return its handle
+    size_t storeQuickTune(const int direction, const size_t channel, const double frequency, const bladerf_quick_tune &quickTune);
+
+    //! Rebuild the frequency index after the tolerance changed, warns about entries that a closer one shadows
+    void reindexQuickTunes(void);
+
     //! Gets the quick tune info at the current frequency. Only available on BladeRF2.
-    bladerf_quick_tune* getQuickTune(const int direction, const size_t channel) const;
+    bool getQuickTune(const int direction, const size_t channel, bladerf_quick_tune &quickTune) const;
     /*!
      * Retunes to a specific quick tune.Only available on BladeRF2.
      * This is usually not blocking (bladerf_schedule_retune is usually not blocking, unlike bladerf_set_frequency).
      */
     void retune(const int direction, const size_t channel, long long timestamp, bladerf_quick_tune* conf);
+
+    //! Retunes to a saved quick tune by handle, the timestamp is in ticks like retune().
+    void retuneHandle(const size_t handle, long long timestamp);
     //! Sets the RF frequency. Throws a runtime_error if bladerf_set_frequency is unsuccessful.
     void setRfFrequency(const int direction, const size_t channel, const double frequency);
+
+    //! The serial and versions that a quick tune file must match
+    std::string quickTuneFileKey(void) const;
+
+    /*!
+     * Tune and store the quick tune of one frequency, replacing a previous one.
+     * libbladeRF never recycles profiles, re-saving a frequency takes a new
+     * one and the old one stays lost until the FPGA is reloaded.
+     * Throws once all profiles of the direction are used.
+     * \return the profile slot of the replaced quick tune, or -1
+     */
+    int saveQuickTuneAt(const int direction, const size_t channel, const double frequency);
+
+    //! Profiles handed out since the FPGA was loaded or reset, libbladeRF counts each direction on its own
+    size_t &_quickTuneProfilesUsed(const int direction)
+    {
+        return _quickTuneProfiles[(direction == SOAPY_SDR_RX)?0:1];
+    }
+    size_t _quickTuneProfiles[2]; //rx, tx
+    bool _quickTunesLoaded; //the table holds profiles from a file, new saves would reuse their slots
+
+    //! Forget the quick tunes after the FPGA profile memory was wiped by a load or reset
+    void _invalidateQuickTunes(void)
+    {
+        _quickTunes.clear();
+        _quickTuneIndex.clear();
+        _quickTuneProfilesUsed(SOAPY_SDR_RX) = 0;
+        _quickTuneProfilesUsed(SOAPY_SDR_TX) = 0;
+        _quickTunesLoaded = false;
+    }
+    QuickTuneSweepResult _lastSweep; //reported by the quick_tune_sweep setting
+
+    //! A retune waiting for room in the FPGA retune queue
+    struct PendingRetune
+    {
+        int direction;
+        long long timeNs;
+        bladerf_channel ch;
+        bladerf_timestamp ticks;
+        bladerf_frequency frequency;
+        bool hasQuickTune;
+        bladerf_quick_tune quickTune;
+    };
+
+    //! The hop thread loop, keeps the FPGA retune queue filled and applies timed gains
+    void hopLoop(void);
+
+    //! True when a hop of the direction at this time was dropped recently, or is still queued after its time
+    bool hopMissed(const int direction, const long long timeNs) const;
+
+    //! Count and remember a dropped hop, call with _hopMutex held
+    void recordHopFailure(const int direction, const long long timeNs, const std::string &what);
+
+    mutable std::mutex _hopMutex;
+    std::condition_variable _hopCond;
+    std::deque<PendingRetune> _hopRetunes; //in time order
+    std::deque<long long> _hopInFlight; //hardware times of the retunes in the FPGA queue
+    std::deque<HopCommand> _hopGains; //in time order
+    std::thread _hopThread;
+    bool _hopDone;
+    unsigned long long _hopGeneration; //bumped by clearHops()
+    HopStatus _hopStatus;
+    std::deque<std::pair<int, long long>> _hopFailures; //direction and time of the recently dropped hops
+
+    //! The members of this device's group, call with the group registry locked
+    std::vector<bladeRF_SoapySDR *> groupMembers(void) const;
+
+    std::string _groupName; //empty when not in a group
+
+    //! Read every telemetry value from the device, values that fail are left out
+    SoapySDR::Kwargs sampleTelemetry(void) const;
+
+    //! The telemetry sampler thread loop
+    void telemetryLoop(void);
+
+    //! A cached telemetry value, false when the sampler has none
+    bool readTelemetry(const std::string &key, std::string &value) const;
+
+    mutable std::mutex _telemetryMutex;
+    std::condition_variable _telemetryCond;
+    SoapySDR::Kwargs _telemetry; //the last sample, see readSensorSnapshot()
+    std::chrono::steady_clock::time_point _telemetryTime;
+    long _telemetryIntervalMs; //0 when the sampler is off
+    std::thread _telemetryThread;
+    bool _telemetryDone;
+
+    /*!
+     * Write-through cache of the getGain(), getGainMode(), getFrequency(),
+     * getSampleRate(), and getBandwidth() values. The setters forget the
+     * values they may change and the getters refill them with one read.
+     * A NAN entry stays uncached until a setter replaces it, it marks a
+     * frequency that a timed retune changes behind the driver's back.
+     */
+    enum SettingKind
+    {
+        SETTING_GAIN,
+        SETTING_GAIN_MODE,
+        SETTING_FREQUENCY,
+        SETTING_SAMPLE_RATE,
+        SETTING_BANDWIDTH,
+    };
+
+    static unsigned _settingKey(const SettingKind kind, const int direction, const size_t channel)
+    {
+        return (unsigned(kind) << 8) | ((direction == SOAPY_SDR_RX)?0x80:0) | unsigned(channel & 0x7f);
+    }
+
+    //! A cached value, or false with the generation to pass to _cacheSetting() after the device read
+    bool _getCachedSetting(const unsigned key, double &value, unsigned long long &generation) const;
+
+    //! Keep a value read from the device unless a setter ran since the generation was taken
+    void _cacheSetting(const unsigned key, const double value, const unsigned long long generation) const;
+
+    //! Forget a kind of value on every channel of a direction, or of both directions when direction is -1
+    void _forgetSettings(const SettingKind kind, const int direction);
+
+    //! Stop caching the frequencies of a direction until the next setFrequency()
+    void _uncacheFrequencies(const int direction);
+
+    //! Forget every cached value after a device reset, FPGA load, or raw register write
+    void _invalidateSettingsCache(void);
+
+    mutable std::mutex _settingsMutex;
+    mutable std::unordered_map<unsigned, double> _settingsCache; //by _settingKey()
+    unsigned long long _settingsGeneration; //bumped by every setter
 };
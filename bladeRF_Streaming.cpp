@@ -20,6 +20,7 @@
  */
 
 #include "bladeRF_SoapySDR.hpp"
+#include "bladeRF_Convert.hpp"
 #include <SoapySDR/Formats.hpp>
 #include <SoapySDR/Logger.hpp>
 #include <stdexcept>
@@ -27,13 +28,89 @@
 #include <thread>
 #include <chrono>
 #include <cstring> //memset
+#include <algorithm> //find
+#include <cmath> //ceil
+#include <memory>
+#include <cstdlib> //strtoull
+#include <sstream>
 
 #define DEF_NUM_BUFFS 32
 #define DEF_BUFF_LEN 4096
+#define DEF_RING_BYTES (16*1024*1024)
+#define DEF_TX_LEAD 4
+
+//low latency rx, the smallest transfers libbladeRF accepts
+#define LOW_LATENCY_NUM_BUFFS 8
+#define LOW_LATENCY_BUFF_LEN 1024
+#define LOW_LATENCY_NUM_XFERS 4
+
+//automatic buffer sizing, see autoStreamBuffers()
+#define AUTO_BUFF_TIME_US 1000 //fill time of one buffer when sizing for throughput
+#define AUTO_JITTER_US 32000 //host stall covered by the buffers when sizing for throughput
+#define AUTO_MAX_BUFF_LEN 65536
+#define AUTO_MAX_NUM_BUFFS 128
+
+//scan mode, see refillScan()
+#define SCAN_DEF_SETTLE_US 200 //retune settling time skipped before each dwell
+#define SCAN_LOOKAHEAD 8 //dwells queued ahead of the reader, the FPGA retune queue holds 16
+#define SCAN_LEAD_NS 2000000 //earliest retune after the hardware time, for the hop thread and the FPGA queue
+
+//! parse a scan list, entries "frequency" or "frequency:gain" separated by ','
+static std::vector<RxScan::Step> parseScanSteps(const std::string &value)
+{
+    std::vector<RxScan::Step> steps;
+    std::stringstream ss(value);
+    std::string entry;
+    while (std::getline(ss, entry, ','))
+    {
+        if (entry.empty()) continue;
+        const size_t colon = entry.find(':');
+        RxScan::Step step;
+        step.frequency = std::atof(entry.substr(0, colon).c_str());
+        step.gain = (colon == std::string::npos)?NAN:std::atof(entry.substr(colon+1).c_str());
+        if (step.frequency <= 0.0) throw std::runtime_error("setupStream invalid scan entry " + entry);
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+/*!
+ * Adds the lifetime of the timer to a nanosecond counter,
+ * or to the latency histogram of a stream when no counter is given.
+ */
+struct ScopedTimer
+{
+    ScopedTimer(std::atomic<unsigned long long> &counter):
+        counter(&counter),
+        stats(nullptr),
+        start(std::chrono::steady_clock::now())
+    {
+        return;
+    }
+
+    ScopedTimer(StreamStats &stats):
+        counter(nullptr),
+        stats(&stats),
+        start(std::chrono::steady_clock::now())
+    {
+        return;
+    }
+
+    ~ScopedTimer(void)
+    {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (counter != nullptr) *counter += ns;
+        if (stats != nullptr) stats->addLatency(ns);
+    }
+
+    std::atomic<unsigned long long> *counter;
+    StreamStats *stats;
+    const std::chrono::steady_clock::time_point start;
+};
 
 std::vector<std::string> bladeRF_SoapySDR::getStreamFormats(const int, const size_t) const
 {
-    return {SOAPY_SDR_CS16, SOAPY_SDR_CF32};
+    return {SOAPY_SDR_CS16, SOAPY_SDR_CF32, SOAPY_SDR_CS8};
 }
 
 std::string bladeRF_SoapySDR::getNativeStreamFormat(const int, const size_t, double &fullScale) const
@@ -42,7 +119,7 @@ std::string bladeRF_SoapySDR::getNativeStreamFormat(const int, const size_t, dou
     return SOAPY_SDR_CS16;
 }
 
-SoapySDR::ArgInfoList bladeRF_SoapySDR::getStreamArgsInfo(const int, const size_t) const
+SoapySDR::ArgInfoList bladeRF_SoapySDR::getStreamArgsInfo(const int direction, const size_t) const
 {
     SoapySDR::ArgInfoList streamArgs;
 
@@ -50,7 +127,8 @@ SoapySDR::ArgInfoList bladeRF_SoapySDR::getStreamArgsInfo(const int, const size_
     buffersArg.key = "buffers";
     buffersArg.value = std::to_string(DEF_NUM_BUFFS);
     buffersArg.name = "Buffer Count";
-    buffersArg.description = "Number of async USB buffers.";
+    buffersArg.description = "Number of async USB buffers.\n"
+        "Use auto to size the buffers, buffer length, and transfers from the sample rate, layout, and USB speed.";
     buffersArg.units = "buffers";
     buffersArg.type = SoapySDR::ArgInfo::INT;
     streamArgs.push_back(buffersArg);
@@ -64,6 +142,15 @@ SoapySDR::ArgInfoList bladeRF_SoapySDR::getStreamArgsInfo(const int, const size_
     lengthArg.type = SoapySDR::ArgInfo::INT;
     streamArgs.push_back(lengthArg);
 
+    SoapySDR::ArgInfo latencyArg;
+    latencyArg.key = "latency_us";
+    latencyArg.value = "0";
+    latencyArg.name = "Target Latency";
+    latencyArg.description = "Target buffering latency for automatic buffer sizing, implies buffers=auto.\n"
+        "Use 0 to size the buffers for throughput.";
+    latencyArg.units = "us";
+    latencyArg.type = SoapySDR::ArgInfo::INT;
+
     SoapySDR::ArgInfo xfersArg;
     xfersArg.key = "transfers";
     xfersArg.value = "0";
@@ -73,6 +160,7 @@ SoapySDR::ArgInfoList bladeRF_SoapySDR::getStreamArgsInfo(const int, const size_
     xfersArg.type = SoapySDR::ArgInfo::INT;
     xfersArg.range = SoapySDR::Range(0, 32);
     streamArgs.push_back(xfersArg);
+    streamArgs.push_back(latencyArg);
 
     SoapySDR::ArgInfo metaArg;
     xfersArg.key = "meta";
@@ -85,6 +173,210 @@ SoapySDR::ArgInfoList bladeRF_SoapySDR::getStreamArgsInfo(const int, const size_
     xfersArg.optionNames = {"Automatic", "Metadata Streams", "Normal Streams"};
     streamArgs.push_back(metaArg);
 
+    SoapySDR::ArgInfo wireArg;
+    wireArg.key = "wire";
+    wireArg.value = "auto";
+    wireArg.name = "Wire Format";
+    wireArg.description = "Sample format over USB.\n"
+        "SC8_Q7 carries twice the samples per transfer at 8-bit resolution.\n"
+        "Automatic: sc8 for the CS8 format, sc16 otherwise";
+    wireArg.type = SoapySDR::ArgInfo::STRING;
+    wireArg.options = {"auto", "sc16", "sc8"};
+    wireArg.optionNames = {"Automatic", "SC16_Q11", "SC8_Q7"};
+    streamArgs.push_back(wireArg);
+
+    SoapySDR::ArgInfo directArg;
+    directArg.key = "direct";
+    directArg.value = "false";
+    directArg.name = "Direct Access";
+    directArg.description = "Use the libbladeRF async API for direct buffer access.\n"
+        "Requires the wire format (CS16, or CS8 over sc8) on a single channel, timestamps are not available.";
+    directArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(directArg);
+
+    SoapySDR::ArgInfo mlockArg;
+    mlockArg.key = "mlock";
+    mlockArg.value = "false";
+    mlockArg.name = "Lock Buffers";
+    mlockArg.description = "Lock the conversion buffer into memory with mlock().";
+    mlockArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(mlockArg);
+
+    SoapySDR::ArgInfo hugeArg;
+    hugeArg.key = "hugepages";
+    hugeArg.value = "false";
+    hugeArg.name = "Huge Pages";
+    hugeArg.description = "Back the conversion buffer with huge pages when available.";
+    hugeArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(hugeArg);
+
+    SoapySDR::ArgInfo ringArg;
+    ringArg.key = "ring_bytes";
+    ringArg.value = std::to_string(DEF_RING_BYTES);
+    ringArg.name = "Ring Size";
+    ringArg.description = "Number of bytes of samples held by the reader or writer thread ring buffer.";
+    ringArg.units = "bytes";
+    ringArg.type = SoapySDR::ArgInfo::INT;
+
+    if (direction == SOAPY_SDR_RX)
+    {
+        SoapySDR::ArgInfo threadArg;
+        threadArg.key = "rx_thread";
+        threadArg.value = "false";
+        threadArg.name = "Reader Thread";
+        threadArg.description = "Drain libbladeRF from a dedicated thread into a ring buffer.\n"
+            "readStream() pops from the ring so caller stalls do not overflow the device.";
+        threadArg.type = SoapySDR::ArgInfo::BOOL;
+        streamArgs.push_back(threadArg);
+        streamArgs.push_back(ringArg);
+
+        SoapySDR::ArgInfo lowLatencyArg;
+        lowLatencyArg.key = "low_latency";
+        lowLatencyArg.value = "false";
+        lowLatencyArg.name = "Low Latency";
+        lowLatencyArg.description = "Return from readStream() as soon as one transfer is available.\n"
+            "Short timeouts are respected instead of the two buffer minimum, and the default buffers are small.";
+        lowLatencyArg.type = SoapySDR::ArgInfo::BOOL;
+        streamArgs.push_back(lowLatencyArg);
+
+        SoapySDR::ArgInfo keepEnabledArg;
+        keepEnabledArg.key = "keep_enabled";
+        keepEnabledArg.value = "false";
+        keepEnabledArg.name = "Keep Enabled";
+        keepEnabledArg.description = "Leave the channels enabled and the sync configuration applied after closeStream(),\n"
+            "so that reopening an identical stream skips the setup. The channels keep receiving until the next stream or the device is closed.";
+        keepEnabledArg.type = SoapySDR::ArgInfo::BOOL;
+        streamArgs.push_back(keepEnabledArg);
+
+        SoapySDR::ArgInfo recordArg;
+        recordArg.key = "record";
+        recordArg.value = "";
+        recordArg.name = "Record File";
+        recordArg.description = "Record the samples to this file instead of returning them from readStream().\n"
+            "The stream format must be the wire format. An index of the chunk offsets, hardware timestamps, and overruns is written to the file name with .idx appended.";
+        recordArg.type = SoapySDR::ArgInfo::STRING;
+        streamArgs.push_back(recordArg);
+
+        SoapySDR::ArgInfo recordModeArg;
+        recordModeArg.key = "record_mode";
+        recordModeArg.value = "mmap";
+        recordModeArg.name = "Record Mode";
+        recordModeArg.description = "Receive into a shared mapping of the file, or stage and write with O_DIRECT.";
+        recordModeArg.type = SoapySDR::ArgInfo::STRING;
+        recordModeArg.options = {"mmap", "direct"};
+        streamArgs.push_back(recordModeArg);
+
+        SoapySDR::ArgInfo recordBytesArg;
+        recordBytesArg.key = "record_bytes";
+        recordBytesArg.value = "0";
+        recordBytesArg.name = "Record Size";
+        recordBytesArg.description = "End the recording at this file size, 0 records until deactivated.";
+        recordBytesArg.units = "bytes";
+        recordBytesArg.type = SoapySDR::ArgInfo::INT;
+        streamArgs.push_back(recordBytesArg);
+
+        SoapySDR::ArgInfo scanArg;
+        scanArg.key = "scan";
+        scanArg.value = "";
+        scanArg.name = "Scan List";
+        scanArg.description = "Sweep the frequencies of this list, entries \"frequency\" or \"frequency:gain\" separated by commas.\n"
+            "Each step retunes at a fixed time through the hop schedule, using a saved quick tune when there is one, "
+            "and delivers one dwell of samples, see readScan().";
+        scanArg.type = SoapySDR::ArgInfo::STRING;
+        streamArgs.push_back(scanArg);
+
+        SoapySDR::ArgInfo dwellArg;
+        dwellArg.key = "scan_dwell";
+        dwellArg.value = "0";
+        dwellArg.name = "Scan Dwell";
+        dwellArg.description = "Samples delivered per scan step, 0 for one buffer length.";
+        dwellArg.units = "samples";
+        dwellArg.type = SoapySDR::ArgInfo::INT;
+        streamArgs.push_back(dwellArg);
+
+        SoapySDR::ArgInfo settleArg;
+        settleArg.key = "scan_settle";
+        settleArg.value = "";
+        settleArg.name = "Scan Settle";
+        settleArg.description = "Samples skipped after each retune, the default covers " + std::to_string(SCAN_DEF_SETTLE_US) + " us.";
+        settleArg.units = "samples";
+        settleArg.type = SoapySDR::ArgInfo::INT;
+        streamArgs.push_back(settleArg);
+
+        SoapySDR::ArgInfo scanLoopArg;
+        scanLoopArg.key = "scan_loop";
+        scanLoopArg.value = "true";
+        scanLoopArg.name = "Scan Loop";
+        scanLoopArg.description = "Repeat the sweep until the stream is deactivated, otherwise stop after one sweep.";
+        scanLoopArg.type = SoapySDR::ArgInfo::BOOL;
+        streamArgs.push_back(scanLoopArg);
+    }
+
+    if (direction == SOAPY_SDR_TX)
+    {
+        SoapySDR::ArgInfo threadArg;
+        threadArg.key = "tx_thread";
+        threadArg.value = "false";
+        threadArg.name = "Writer Thread";
+        threadArg.description = "Queue writeStream() samples into a ring buffer drained by a dedicated thread.";
+        threadArg.type = SoapySDR::ArgInfo::BOOL;
+        streamArgs.push_back(threadArg);
+        streamArgs.push_back(ringArg);
+
+        SoapySDR::ArgInfo leadArg;
+        leadArg.key = "tx_lead";
+        leadArg.value = std::to_string(DEF_TX_LEAD);
+        leadArg.name = "Lead Depth";
+        leadArg.description = "Number of queued buffers the writer thread waits for before starting a burst.";
+        leadArg.units = "buffers";
+        leadArg.type = SoapySDR::ArgInfo::INT;
+        streamArgs.push_back(leadArg);
+
+        SoapySDR::ArgInfo replayArg;
+        replayArg.key = "replay";
+        replayArg.value = "";
+        replayArg.name = "Replay File";
+        replayArg.description = "Transmit this file from activateStream() until deactivateStream() instead of taking samples from writeStream().\n"
+            "The file holds samples in the stream format, which must be the wire format. A timed activation starts the burst at that time.";
+        replayArg.type = SoapySDR::ArgInfo::STRING;
+        streamArgs.push_back(replayArg);
+
+        SoapySDR::ArgInfo loopArg;
+        loopArg.key = "replay_loop";
+        loopArg.value = "false";
+        loopArg.name = "Replay Loop";
+        loopArg.description = "Wrap around at the end of the replay file without ending the burst.";
+        loopArg.type = SoapySDR::ArgInfo::BOOL;
+        streamArgs.push_back(loopArg);
+    }
+
+    SoapySDR::ArgInfo affinityArg;
+    affinityArg.key = "cpu_affinity";
+    affinityArg.value = "";
+    affinityArg.name = "CPU Affinity";
+    affinityArg.description = "Pin the stream threads and the libbladeRF transfer threads to cpus, as in '2,3' or '4-7'.\n"
+        "Defaults to the cpu_affinity device setting.";
+    affinityArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(affinityArg);
+
+    SoapySDR::ArgInfo priorityArg;
+    priorityArg.key = "rt_priority";
+    priorityArg.value = "0";
+    priorityArg.name = "Realtime Priority";
+    priorityArg.description = "Run the stream threads and the libbladeRF transfer threads with SCHED_FIFO at this priority.\n"
+        "This needs CAP_SYS_NICE or an rtprio limit, 0 keeps the default scheduler.";
+    priorityArg.type = SoapySDR::ArgInfo::INT;
+    priorityArg.range = SoapySDR::Range(0, 99);
+    streamArgs.push_back(priorityArg);
+
+    SoapySDR::ArgInfo numaArg;
+    numaArg.key = "numa_node";
+    numaArg.value = "";
+    numaArg.name = "NUMA Node";
+    numaArg.description = "Allocate the stream buffers on this memory node, 'local' uses the node of the first cpu_affinity cpu.";
+    numaArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(numaArg);
+
     return streamArgs;
 }
 
@@ -123,107 +415,410 @@ SoapySDR::Stream *bladeRF_SoapySDR::setupStream(
     //check the format
     if (format == SOAPY_SDR_CF32) {}
     else if (format == SOAPY_SDR_CS16) {}
+    else if (format == SOAPY_SDR_CS8) {}
     else throw std::runtime_error("setupStream invalid format " + format);
 
+    //wire format, 8-bit samples use the SC8_Q7 variant of the selected meta mode
+    auto wireMode = (args.count("wire") == 0)? "auto" : args.at("wire");
+    bool wire8 = (format == SOAPY_SDR_CS8);
+    if (wireMode == "sc8") wire8 = true;
+    else if (wireMode == "sc16") wire8 = false;
+    else if (wireMode != "auto") throw std::runtime_error("setupStream invalid wire format " + wireMode);
+    if (format == SOAPY_SDR_CS8 and not wire8) throw std::runtime_error("setupStream format " SOAPY_SDR_CS8 " requires wire format sc8");
+    if (wire8) sync_format = (sync_format == BLADERF_FORMAT_SC16_Q11_META)?BLADERF_FORMAT_SC8_Q7_META:BLADERF_FORMAT_SC8_Q7;
+
+    //automatic buffering when any of the buffer args is auto or a latency target is given
+    const auto isAuto = [&args](const std::string &key){return args.count(key) != 0 and args.at(key) == "auto";};
+    const long latencyUs = (args.count("latency_us") == 0)? 0 : atol(args.at("latency_us").c_str());
+    const bool autoBuffs = isAuto("buffers") or isAuto("buflen") or isAuto("transfers") or latencyUs > 0;
+    int autoNumBuffs(0), autoBufSize(0), autoNumXfers(0);
+    if (autoBuffs) this->autoStreamBuffers(direction, channels.size(), wire8, latencyUs, autoNumBuffs, autoBufSize, autoNumXfers);
+
+    //low latency rx defaults to small buffers unless they are given or automatic
+    const bool lowLatency = (direction == SOAPY_SDR_RX) and (args.count("low_latency") != 0) and
+        (args.at("low_latency") == "true" or args.at("low_latency") == "1");
+    if (lowLatency and not autoBuffs)
+    {
+        autoNumBuffs = LOW_LATENCY_NUM_BUFFS;
+        autoBufSize = LOW_LATENCY_BUFF_LEN;
+        autoNumXfers = LOW_LATENCY_NUM_XFERS;
+    }
+    const bool pickedBuffs = autoBuffs or lowLatency;
+
     //determine the number of buffers to allocate
     int numBuffs = (args.count("buffers") == 0)? 0 : atoi(args.at("buffers").c_str());
-    if (numBuffs == 0) numBuffs = DEF_NUM_BUFFS;
+    if (numBuffs == 0) numBuffs = pickedBuffs?autoNumBuffs:DEF_NUM_BUFFS;
     if (numBuffs == 1) numBuffs++;
 
     //determine the size of each buffer in samples
     int bufSize = (args.count("buflen") == 0)? 0 : atoi(args.at("buflen").c_str());
-    if (bufSize == 0) bufSize = DEF_BUFF_LEN;
+    if (bufSize == 0) bufSize = pickedBuffs?autoBufSize:DEF_BUFF_LEN;
     if ((bufSize % 1024) != 0) bufSize = ((bufSize/1024) + 1) * 1024;
 
     //determine the number of active transfers
     int numXfers = (args.count("transfers") == 0)? 0 : atoi(args.at("transfers").c_str());
-    if (numXfers == 0) numXfers = numBuffs/2;
+    if (numXfers == 0) numXfers = pickedBuffs?std::min(autoNumXfers, numBuffs):numBuffs/2;
     if (numXfers > numBuffs) numXfers = numBuffs; //cant have more than available buffers
     if (numXfers > 32) numXfers = 32; //libusb limit
 
-    //setup the stream for sync tx/rx calls
-    int ret = bladerf_sync_config(
-        _dev,
-        layout,
-        sync_format,
-        numBuffs,
-        bufSize,
-        numXfers,
-        1000); //1 second timeout
-    if (ret != 0)
+    //direct buffer access mode uses the async API instead of sync calls
+    const bool direct = (args.count("direct") != 0) and (args.at("direct") == "true" or args.at("direct") == "1");
+    if (direct)
     {
-        SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_config() returned %d", ret);
-        throw std::runtime_error("setupStream() " + _err2str(ret));
+        if (format != (wire8?SOAPY_SDR_CS8:SOAPY_SDR_CS16)) throw std::runtime_error("setupStream direct access requires the wire format");
+        if (channels.size() != 1) throw std::runtime_error("setupStream direct access requires a single channel");
+        if (numXfers == numBuffs) numXfers--; //the caller needs at least one buffer
+        if (metaMode == "meta") SoapySDR::logf(SOAPY_SDR_WARNING, "setupStream direct access ignores meta mode");
     }
 
-    //enable channels used in streaming
-    for (const auto ch : channels)
+    //reader and writer threads
+    const bool rxThread = (args.count("rx_thread") != 0) and (args.at("rx_thread") == "true" or args.at("rx_thread") == "1");
+    const bool txThread = (args.count("tx_thread") != 0) and (args.at("tx_thread") == "true" or args.at("tx_thread") == "1");
+    if (direction == SOAPY_SDR_RX and rxThread and direct) throw std::runtime_error("setupStream rx_thread is not supported with direct access");
+    if (direction == SOAPY_SDR_TX and txThread and direct) throw std::runtime_error("setupStream tx_thread is not supported with direct access");
+
+    //record to file mode receives in place, so the caller format must be the wire format
+    const std::string recordPath = (args.count("record") == 0)? "" : args.at("record");
+    const bool record = (direction == SOAPY_SDR_RX) and not recordPath.empty();
+    const std::string recordMode = (args.count("record_mode") == 0)? "mmap" : args.at("record_mode");
+    if (record)
     {
-        ret = bladerf_enable_module(_dev, _toch(direction, ch), true);
-        if (ret != 0)
+        if (format != (wire8?SOAPY_SDR_CS8:SOAPY_SDR_CS16)) throw std::runtime_error("setupStream record requires the wire format");
+        if (direct or rxThread) throw std::runtime_error("setupStream record is not supported with direct access or rx_thread");
+        if (recordMode != "mmap" and recordMode != "direct") throw std::runtime_error("setupStream invalid record mode " + recordMode);
+
+        //the index needs the timestamps
+        if (sync_format == BLADERF_FORMAT_SC16_Q11) sync_format = BLADERF_FORMAT_SC16_Q11_META;
+        if (sync_format == BLADERF_FORMAT_SC8_Q7) sync_format = BLADERF_FORMAT_SC8_Q7_META;
+    }
+
+    //replay from file mode sends the mapped file, so the caller format must be the wire format
+    const std::string replayPath = (args.count("replay") == 0)? "" : args.at("replay");
+    const bool replay = (direction == SOAPY_SDR_TX) and not replayPath.empty();
+    const bool replayLoop = (args.count("replay_loop") != 0) and (args.at("replay_loop") == "true" or args.at("replay_loop") == "1");
+    if (replay)
+    {
+        if (format != (wire8?SOAPY_SDR_CS8:SOAPY_SDR_CS16)) throw std::runtime_error("setupStream replay requires the wire format");
+        if (direct or txThread) throw std::runtime_error("setupStream replay is not supported with direct access or tx_thread");
+
+        //bursts and timed starts need the metadata
+        if (sync_format == BLADERF_FORMAT_SC16_Q11) sync_format = BLADERF_FORMAT_SC16_Q11_META;
+        if (sync_format == BLADERF_FORMAT_SC8_Q7) sync_format = BLADERF_FORMAT_SC8_Q7_META;
+    }
+
+    //scan mode queues one timed command per dwell, so the reads need the timestamps
+    const std::string scanList = (args.count("scan") == 0)? "" : args.at("scan");
+    const bool scan = (direction == SOAPY_SDR_RX) and not scanList.empty();
+    if (scan)
+    {
+        if (direct or rxThread or record) throw std::runtime_error("setupStream scan is not supported with direct access, rx_thread, or record");
+        if (sync_format == BLADERF_FORMAT_SC16_Q11) sync_format = BLADERF_FORMAT_SC16_Q11_META;
+        if (sync_format == BLADERF_FORMAT_SC8_Q7) sync_format = BLADERF_FORMAT_SC8_Q7_META;
+    }
+
+    //thread placement and buffer memory node, the device settings are the defaults
+    const ThreadPolicy policy = ThreadPolicy::fromArgs(args, _threadPolicy);
+
+    StreamState *state = new StreamState(direction);
+    state->chans = channels;
+    state->layout = layout;
+    state->syncFormat = sync_format;
+    state->numBuffs = numBuffs;
+    state->buffSize = bufSize;
+    state->numXfers = numXfers;
+    state->floats = (format == SOAPY_SDR_CF32);
+    state->cs8 = (format == SOAPY_SDR_CS8);
+    state->wire8 = wire8;
+    state->lowLatency = lowLatency;
+    state->keepEnabled = (direction == SOAPY_SDR_RX) and (args.count("keep_enabled") != 0) and
+        (args.at("keep_enabled") == "true" or args.at("keep_enabled") == "1");
+    state->policy = policy;
+    if (not direct)
+    {
+        //page aligned conversion buffer from the device pool, optionally pinned
+        const bool locked = (args.count("mlock") != 0) and (args.at("mlock") == "true" or args.at("mlock") == "1");
+        const bool hugePages = (args.count("hugepages") != 0) and (args.at("hugepages") == "true" or args.at("hugepages") == "1");
+        state->pool = &_buffPool;
+        state->convBuff = (int16_t *)_buffPool.acquire(bufSize*2*channels.size()*sizeof(int16_t), locked, hugePages, policy.numaNode);
+    }
+
+    if (direct)
+    {
+        AsyncStream *async = new AsyncStream();
+        async->layout = layout;
+        async->numBuffs = numBuffs;
+        async->numXfers = numXfers;
+        async->buffSize = bufSize;
+        async->elemBytes = wire8?2:4;
+        async->policy = policy;
+        state->async = async;
+    }
+
+    //optional reader or writer thread ring, one slot per sync call
+    if ((direction == SOAPY_SDR_RX and rxThread) or (direction == SOAPY_SDR_TX and txThread))
+    {
+        const size_t slotScalars = bufSize*state->elemBytes()/sizeof(int16_t);
+        long long ringBytes = (args.count("ring_bytes") == 0)? 0 : atoll(args.at("ring_bytes").c_str());
+        if (ringBytes <= 0) ringBytes = DEF_RING_BYTES;
+        const size_t numSlots = std::max<size_t>(size_t(ringBytes)/(slotScalars*sizeof(int16_t)), 2);
+
+        //the slots are zeroed on the policy's cpus, so their pages land on that node
+        policy.run([&](void)
         {
-            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_enable_module(true) returned %d", ret);
-            throw std::runtime_error("setupStream() " + _err2str(ret));
+            if (direction == SOAPY_SDR_RX) state->rxRing = new RxRing(numSlots, slotScalars);
+            if (direction == SOAPY_SDR_TX) state->txRing = new TxRing(numSlots, slotScalars);
+        });
+        if (direction == SOAPY_SDR_TX)
+        {
+            state->txRingLead = (args.count("tx_lead") == 0)? DEF_TX_LEAD : size_t(atoi(args.at("tx_lead").c_str()));
+            state->txRingLead = std::min(state->txRingLead, numSlots-1);
         }
     }
 
-    if (direction == SOAPY_SDR_RX)
+    if (record) try
+    {
+        const unsigned long long maxBytes = (args.count("record_bytes") == 0)? 0 : std::strtoull(args.at("record_bytes").c_str(), nullptr, 10);
+        RecordFile *file = new RecordFile(recordPath, bufSize*state->elemBytes(), maxBytes, recordMode == "direct");
+        state->recorder = new RxRecorder(file);
+        file->comment("bladeRF rx recording format=" + std::string(wire8?"SC8_Q7":"SC16_Q11") +
+            " channels=" + std::to_string(channels.size()) + " rate=" + std::to_string(_rxSampRate));
+        file->comment("byte_offset num_bytes ticks time_ns [overrun]");
+    }
+    catch (...)
     {
-        _rxOverflow = false;
-        _rxChans = channels;
-        _rxFloats = (format == SOAPY_SDR_CF32);
-        _rxConvBuff = new int16_t[bufSize*2*_rxChans.size()];
-        _rxBuffSize = bufSize;
-        this->updateRxMinTimeoutMs();
+        delete state;
+        throw;
     }
 
-    if (direction == SOAPY_SDR_TX)
+    if (replay) try
+    {
+        ReplayFile *file = new ReplayFile(replayPath);
+        state->replay = new TxReplay(file, replayLoop);
+        if (file->size() < state->elemBytes()) throw std::runtime_error("setupStream replay file " + replayPath + " holds no whole sample");
+        if ((file->size() % state->elemBytes()) != 0) SoapySDR::logf(SOAPY_SDR_WARNING, "setupStream replay ignores the partial sample at the end of %s", replayPath.c_str());
+    }
+    catch (...)
+    {
+        delete state;
+        throw;
+    }
+
+    if (scan) try
+    {
+        RxScan *rxScan = new RxScan();
+        state->scan = rxScan;
+        rxScan->steps = parseScanSteps(scanList);
+        if (rxScan->steps.empty()) throw std::runtime_error("setupStream scan list is empty");
+        const long long dwell = (args.count("scan_dwell") == 0)? 0 : atoll(args.at("scan_dwell").c_str());
+        rxScan->dwell = (dwell > 0)?size_t(dwell):size_t(bufSize);
+        rxScan->settle = (args.count("scan_settle") == 0 or args.at("scan_settle").empty())?
+            size_t(std::ceil(_rxSampRate*SCAN_DEF_SETTLE_US/1e6)) : size_t(std::max(0LL, atoll(args.at("scan_settle").c_str())));
+        rxScan->loop = (args.count("scan_loop") == 0) or (args.at("scan_loop") == "true" or args.at("scan_loop") == "1");
+
+        //the bladeRF2 hop schedule only takes retunes with a quick tune
+        if (_isBladeRF2) for (const auto &step : rxScan->steps)
+        {
+            if (this->findQuickTune(direction, channels.front(), step.frequency) >= 0) continue;
+            throw std::runtime_error("setupStream scan " + std::to_string(step.frequency/1e6) + " MHz has no saved quick tune, see the quick_tune_sweep setting");
+        }
+    }
+    catch (...)
+    {
+        delete state;
+        throw;
+    }
+
+    //setup the stream for sync tx/rx calls and enable the channels
+    //an active stream of the same direction keeps its configuration until activation
+    StreamState *current = (direction == SOAPY_SDR_RX)?_rxSyncStream:_txSyncStream;
+    try
     {
-        _txFloats = (format == SOAPY_SDR_CF32);
-        _txChans = channels;
-        _txConvBuff = new int16_t[bufSize*2*_txChans.size()];
-        _txBuffSize = bufSize;
-        _inTxBurst = false;
+        if (current == nullptr or not current->active) this->applyStreamConfig(state);
+    }
+    catch (...)
+    {
+        delete state;
+        throw;
     }
 
-    return (SoapySDR::Stream *)(new int(direction));
+    return reinterpret_cast<SoapySDR::Stream *>(state);
 }
 
-void bladeRF_SoapySDR::closeStream(SoapySDR::Stream *stream)
+void bladeRF_SoapySDR::autoStreamBuffers(
+    const int direction,
+    const size_t numChans,
+    const bool wire8,
+    const long latencyUs,
+    int &numBuffs,
+    int &bufSize,
+    int &numXfers) const
 {
-    const int direction = *reinterpret_cast<int *>(stream);
-    auto &chans = (direction == SOAPY_SDR_RX)?_rxChans:_txChans;
+    //the USB link sets how long the host may take to resubmit a transfer and the usable bandwidth
+    const bladerf_dev_speed speed = bladerf_device_speed(_dev);
+    const bool superSpeed = (speed == BLADERF_DEVICE_SPEED_SUPER);
+    const double serviceUs = superSpeed?2000:4000;
+    const double linkBytesPerSec = superSpeed?400e6:40e6;
+
+    const double rate = ((direction == SOAPY_SDR_RX)?_rxSampRate:_txSampRate)*numChans;
+    const double bytesPerSec = rate*(wire8?2:4);
+    if (bytesPerSec > linkBytesPerSec) SoapySDR::logf(SOAPY_SDR_WARNING,
+        "setupStream %.1f MB/s exceeds the %s USB link, expect %s", bytesPerSec/1e6,
+        superSpeed?"SuperSpeed":"HighSpeed", (direction == SOAPY_SDR_RX)?"overflows":"underflows");
+
+    //a latency target leaves room for four buffers, otherwise fill each buffer in a millisecond
+    const double fillTargetUs = (latencyUs > 0)?(latencyUs/4.0):AUTO_BUFF_TIME_US;
+    bufSize = int(rate*fillTargetUs/1e6);
+    bufSize = std::max(1024, std::min(AUTO_MAX_BUFF_LEN, (bufSize/1024)*1024));
+    const double fillUs = 1e6*bufSize/rate;
+
+    //enough transfers in flight to cover the resubmit time, and enough buffers to cover the jitter
+    const double jitterUs = (latencyUs > 0)?latencyUs:AUTO_JITTER_US;
+    numXfers = std::max(4, std::min(32, int(std::ceil(serviceUs/fillUs))));
+    numBuffs = std::max(2*numXfers, std::min(AUTO_MAX_NUM_BUFFS, int(std::ceil(jitterUs/fillUs))));
+
+    SoapySDR::logf(SOAPY_SDR_INFO, "setupStream(%s) auto buffers=%d, buflen=%d, transfers=%d (%.0f us per buffer)",
+        (direction == SOAPY_SDR_RX)?"Rx":"Tx", numBuffs, bufSize, numXfers, fillUs);
+}
+
+void bladeRF_SoapySDR::applyStreamConfig(StreamState *state)
+{
+    StreamState *&current = (state->direction == SOAPY_SDR_RX)?_rxSyncStream:_txSyncStream;
+    SyncConfig &config = (state->direction == SOAPY_SDR_RX)?_rxSyncConfig:_txSyncConfig;
+    if (current == state) return;
 
-    //deactivate the stream here -- only call once
-    for (const auto ch : chans)
+    //libbladeRF holds one sync configuration per direction
+    if (current != nullptr and current->active)
     {
-        const int ret = bladerf_enable_module(_dev, _toch(direction, ch), false);
+        throw std::runtime_error("applyStreamConfig() another stream is active in this direction");
+    }
+
+    //the async api of direct access streams replaces the sync configuration,
+    //the channels are disabled first so that neither api is left running on them
+    const bool direct = (state->async != nullptr);
+    if (direct or config.direct) this->releaseStreamConfig(state->direction);
+    const bool same = config.valid and not direct and
+        config.layout == state->layout and
+        config.format == state->syncFormat and
+        config.numBuffs == state->numBuffs and
+        config.buffSize == state->buffSize and
+        config.numXfers == state->numXfers;
+
+    int ret = 0;
+    if (same) SoapySDR::logf(SOAPY_SDR_DEBUG, "applyStreamConfig() reusing the sync configuration");
+    else if (not direct)
+    {
+        config.valid = false;
+
+        //the libbladeRF worker thread and transfer buffers inherit the policy of the configuring thread
+        state->policy.run([&](void)
+        {
+            ret = bladerf_sync_config(
+                _dev,
+                state->layout,
+                state->syncFormat,
+                state->numBuffs,
+                state->buffSize,
+                state->numXfers,
+                1000); //1 second timeout
+        });
         if (ret != 0)
         {
-            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_enable_module(false) returned %s", _err2str(ret).c_str());
-            throw std::runtime_error("closeStream() " + _err2str(ret));
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_config() returned %d", ret);
+            throw std::runtime_error("applyStreamConfig() " + _err2str(ret));
+        }
+    }
+    config.valid = not direct;
+    config.direct = direct;
+    config.layout = state->layout;
+    config.format = state->syncFormat;
+    config.numBuffs = state->numBuffs;
+    config.buffSize = state->buffSize;
+    config.numXfers = state->numXfers;
+
+    //disable channels only used by the previous stream
+    for (auto it = config.enabled.begin(); it != config.enabled.end();)
+    {
+        const size_t ch = *it;
+        if (std::find(state->chans.begin(), state->chans.end(), ch) != state->chans.end()) ++it;
+        else
+        {
+            it = config.enabled.erase(it);
+            ret = bladerf_enable_module(_dev, _toch(state->direction, ch), false);
+            if (ret != 0)
+            {
+                SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_enable_module(false) returned %s", _err2str(ret).c_str());
+                throw std::runtime_error("applyStreamConfig() " + _err2str(ret));
+            }
         }
     }
-    chans.clear();
 
-    //cleanup stream convert buffers
-    if (direction == SOAPY_SDR_RX)
+    //enable channels used in streaming that are not already enabled
+    for (const auto ch : state->chans)
     {
-        delete [] _rxConvBuff;
+        if (std::find(config.enabled.begin(), config.enabled.end(), ch) != config.enabled.end()) continue;
+        ret = bladerf_enable_module(_dev, _toch(state->direction, ch), true);
+        if (ret != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_enable_module(true) returned %d", ret);
+            throw std::runtime_error("applyStreamConfig() " + _err2str(ret));
+        }
+        config.enabled.push_back(ch);
     }
 
-    if (direction == SOAPY_SDR_TX)
+    std::lock_guard<std::mutex> lock(_syncStreamMutex);
+    current = state;
+}
+
+void bladeRF_SoapySDR::releaseStreamConfig(const int direction)
+{
+    SyncConfig &config = (direction == SOAPY_SDR_RX)?_rxSyncConfig:_txSyncConfig;
+    const std::vector<size_t> enabled = config.enabled;
+
+    //disabling a channel tears down the libbladeRF sync state
+    config = SyncConfig();
+    for (const auto ch : enabled)
     {
-        delete [] _txConvBuff;
+        const int ret = bladerf_enable_module(_dev, _toch(direction, ch), false);
+        if (ret != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_enable_module(false) returned %s", _err2str(ret).c_str());
+            throw std::runtime_error("closeStream() " + _err2str(ret));
+        }
     }
+}
 
-    delete reinterpret_cast<int *>(stream);
+void bladeRF_SoapySDR::closeStream(SoapySDR::Stream *stream)
+{
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
+    StreamState *&current = (state->direction == SOAPY_SDR_RX)?_rxSyncStream:_txSyncStream;
+
+    //shutdown the direct access stream
+    if (state->async != nullptr) this->stopAsyncStream(state->async);
+
+    //stop the reader and writer threads
+    if (state->rxRing != nullptr) this->stopRxRing(state);
+    if (state->txRing != nullptr) this->stopTxRing(state);
+    if (state->recorder != nullptr) this->stopRecorder(state);
+    if (state->replay != nullptr) this->stopReplay(state);
+    if (state->scan != nullptr and state->active) this->stopScan(state);
+
+    //the channels stay enabled when another stream holds the configuration;
+    //disabling them tears down the libbladeRF sync state, so only a keep_enabled
+    //rx stream leaves the configuration cached for the next identical stream
+    const bool owner = (current == state);
+    if (owner)
+    {
+        std::lock_guard<std::mutex> lock(_syncStreamMutex);
+        current = nullptr;
+    }
+    std::unique_ptr<StreamState> cleanup(state);
+    if (owner and not state->keepEnabled) this->releaseStreamConfig(state->direction);
 }
 
 size_t bladeRF_SoapySDR::getStreamMTU(SoapySDR::Stream *stream) const
 {
-    const int direction = *reinterpret_cast<int *>(stream);
-    return (direction == SOAPY_SDR_RX)?_rxBuffSize:_txBuffSize;
+    const StreamState *state = reinterpret_cast<const StreamState *>(stream);
+    return state->buffSize;
 }
 
 int bladeRF_SoapySDR::activateStream(
@@ -232,22 +827,67 @@ int bladeRF_SoapySDR::activateStream(
     const long long timeNs,
     const size_t numElems)
 {
-    const int direction = *reinterpret_cast<int *>(stream);
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
 
-    if (direction == SOAPY_SDR_RX)
+    //switching from another stream of this direction re-applies the configuration
+    this->applyStreamConfig(state);
+
+    //direct access streams run continuously until deactivated
+    if (state->async != nullptr)
+    {
+        if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+        this->startAsyncStream(state->async);
+        state->active = true;
+        return 0;
+    }
+
+    //the record thread applies the activation time and burst length itself
+    if (state->recorder != nullptr)
+    {
+        this->startRecorder(state, flags, timeNs, numElems);
+        state->active = true;
+        return 0;
+    }
+
+    //the scan queues its own timed commands, a timed activation starts the first retune
+    if (state->scan != nullptr)
+    {
+        if ((flags & ~SOAPY_SDR_HAS_TIME) != 0) return SOAPY_SDR_NOT_SUPPORTED;
+        this->startScan(state, flags, timeNs);
+        state->active = true;
+        return 0;
+    }
+
+    //the replay thread starts the burst, timed when the activation is
+    if (state->replay != nullptr)
+    {
+        if ((flags & ~SOAPY_SDR_HAS_TIME) != 0) return SOAPY_SDR_NOT_SUPPORTED;
+        state->clockValid = false;
+        this->startReplay(state, flags, timeNs);
+        state->active = true;
+        return 0;
+    }
+
+    if (state->direction == SOAPY_SDR_RX)
     {
         StreamMetadata cmd;
         cmd.flags = flags;
         cmd.timeNs = timeNs;
         cmd.numElems = numElems;
-        _rxCmds.push(cmd);
+        state->cmds.push(cmd);
+
+        //the reader thread streams continuously, commands are applied in readStream
+        if (state->rxRing != nullptr) this->startRxRing(state);
     }
 
-    if (direction == SOAPY_SDR_TX)
+    if (state->direction == SOAPY_SDR_TX)
     {
         if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+        state->clockValid = false;
+        if (state->txRing != nullptr) this->startTxRing(state);
     }
 
+    state->active = true;
     return 0;
 }
 
@@ -256,19 +896,34 @@ int bladeRF_SoapySDR::deactivateStream(
     const int flags,
     const long long)
 {
-    const int direction = *reinterpret_cast<int *>(stream);
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
     if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
 
-    if (direction == SOAPY_SDR_RX)
+    if (state->async != nullptr)
+    {
+        this->stopAsyncStream(state->async);
+        state->active = false;
+        return 0;
+    }
+
+    if (state->direction == SOAPY_SDR_RX)
     {
         //clear all commands when deactivating
-        while (not _rxCmds.empty()) _rxCmds.pop();
+        while (not state->cmds.empty()) state->cmds.pop();
+        state->heldElems = 0;
+        if (state->rxRing != nullptr) this->stopRxRing(state);
+        if (state->recorder != nullptr) this->stopRecorder(state);
+        if (state->scan != nullptr) this->stopScan(state);
     }
 
-    if (direction == SOAPY_SDR_TX)
+    if (state->direction == SOAPY_SDR_TX)
     {
+        //send the queued samples before ending the burst
+        if (state->txRing != nullptr) this->stopTxRing(state);
+        if (state->replay != nullptr) this->stopReplay(state);
+
         //in a burst -> end it
-        if (_inTxBurst)
+        if (state->inBurst)
         {
             //initialize metadata
             bladerf_metadata md;
@@ -277,311 +932,1597 @@ int bladeRF_SoapySDR::deactivateStream(
             md.status = 0;
 
             //send the tx samples
-            _txConvBuff[0] = 0;
-            _txConvBuff[1] = 0;
-            bladerf_sync_tx(_dev, _txConvBuff, 1, &md, 100/*ms*/);
+            state->convBuff[0] = 0;
+            state->convBuff[1] = 0;
+            bladerf_sync_tx(_dev, state->convBuff, 1, &md, 100/*ms*/);
         }
-        _inTxBurst = false;
+        state->inBurst = false;
     }
 
+    state->active = false;
     return 0;
 }
 
+void bladeRF_SoapySDR::countStreamResult(StreamState *state, const int ret)
+{
+    if (ret > 0) state->stats.samples += ret;
+    if (ret == SOAPY_SDR_TIMEOUT) state->stats.timeouts++;
+    if (ret == SOAPY_SDR_TIME_ERROR) state->stats.timeErrors++;
+}
+
 int bladeRF_SoapySDR::readStream(
-    SoapySDR::Stream *,
+    SoapySDR::Stream *stream,
     void * const *buffs,
-    size_t numElems,
+    const size_t numElems,
     int &flags,
     long long &timeNs,
     const long timeoutUs)
 {
-    //clip to the available conversion buffer size
-    numElems = std::min(numElems, _rxBuffSize);
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
+
+    //direct access streams use acquireReadBuffer()
+    if (state->async != nullptr) return SOAPY_SDR_NOT_SUPPORTED;
+
+    //recording streams only report the progress
+    if (state->recorder != nullptr) return this->readStreamRecord(state, flags, timeoutUs);
+
+    //scanning streams deliver the dwells in order
+    if (state->scan != nullptr)
+    {
+        ScopedTimer timer(state->stats);
+        const int ret = this->readStreamScan(state, buffs, numElems, flags, timeNs, timeoutUs, nullptr);
+        this->countStreamResult(state, ret);
+        return ret;
+    }
+
+    //samples come from the reader thread or directly from libbladeRF
+    ScopedTimer timer(state->stats);
+    const int ret = (state->rxRing != nullptr)?
+        this->readStreamRing(state, buffs, numElems, flags, timeNs, timeoutUs):
+        this->readStreamSync(state, buffs, numElems, flags, timeNs, timeoutUs);
+    this->countStreamResult(state, ret);
+    return ret;
+}
 
+int bladeRF_SoapySDR::readStreamSync(
+    StreamState *state,
+    void * const *buffs,
+    size_t numElems,
+    int &flags,
+    long long &timeNs,
+    const long timeoutUs)
+{
     //extract the front-most command
     //no command, this is a timeout...
-    if (_rxCmds.empty()) return SOAPY_SDR_TIMEOUT;
-    StreamMetadata &cmd = _rxCmds.front();
+    if (state->cmds.empty()) return SOAPY_SDR_TIMEOUT;
+    StreamMetadata &cmd = state->cmds.front();
 
     //clear output metadata
     flags = 0;
     timeNs = 0;
 
     //return overflow status indicator
-    if (_rxOverflow)
+    if (state->overflow)
     {
-        _rxOverflow = false;
+        state->overflow = false;
         flags |= SOAPY_SDR_HAS_TIME;
-        timeNs = _rxTicksToTimeNs(_rxNextTicks);
+        timeNs = _rxTicksToTimeNs(state->nextTicks);
         return SOAPY_SDR_OVERFLOW;
     }
 
-    //initialize metadata
-    bladerf_metadata md;
-    std::memset(&md, 0, sizeof(md));
-
-    //without a soapy sdr time flag, set the blade rf now flag
-    if ((cmd.flags & SOAPY_SDR_HAS_TIME) == 0) md.flags |= BLADERF_META_FLAG_RX_NOW;
-    md.timestamp = _timeNsToRxTicks(cmd.timeNs);
     if (cmd.numElems > 0) numElems = std::min(cmd.numElems, numElems);
-    cmd.flags = 0; //clear flags for subsequent calls
 
-    //prepare buffers
-    void *samples = (void *)buffs[0];
-    if (_rxFloats or _rxChans.size() == 2) samples = _rxConvBuff;
-
-    //recv the rx samples
-    const long timeoutMs = std::max(_rxMinTimeoutMs, timeoutUs/1000);
-    int ret = bladerf_sync_rx(_dev, samples, numElems*_rxChans.size(), &md, timeoutMs);
-    if (ret == BLADERF_ERR_TIMEOUT) return SOAPY_SDR_TIMEOUT;
-    if (ret == BLADERF_ERR_TIME_PAST) return SOAPY_SDR_TIME_ERROR;
-    if (ret != 0)
+    //receive one buffer at a time so that a timeout or an error only ends
+    //the read early, native samples are received in place in the caller's buffer
+    const size_t numChans = state->chans.size();
+    const bool native = not state->floats and (state->cs8 == state->wire8) and numChans == 1;
+    const bool meta = (state->syncFormat == BLADERF_FORMAT_SC16_Q11_META or state->syncFormat == BLADERF_FORMAT_SC8_Q7_META);
+    //libbladeRF waits in whole milliseconds and treats 0 as forever, low latency rounds up to 1 ms
+    const long timeoutMs = state->lowLatency?
+        std::max<long>(1, (timeoutUs + 999)/1000):
+        std::max(_rxMinTimeoutMs(state), timeoutUs/1000);
+
+    //the chunk held back after a gap comes first, a timed command starts at its own time instead
+    size_t total = 0;
+    if ((cmd.flags & SOAPY_SDR_HAS_TIME) != 0) state->heldElems = 0;
+    if (state->heldElems > 0)
     {
-        //any error when this is a finite burst causes the command to be removed
-        if (cmd.numElems > 0) _rxCmds.pop();
-        SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_rx() returned %s", _err2str(ret).c_str());
-        return SOAPY_SDR_STREAM_ERROR;
+        const size_t numHeld = std::min(numElems, state->heldElems);
+        const char *held = (const char *)state->convBuff + state->heldOffset*state->elemBytes();
+        if (native) std::memcpy(buffs[0], held, numHeld*state->elemBytes());
+        else this->convertRxSamples(state, held, buffs, numHeld);
+        flags |= SOAPY_SDR_HAS_TIME;
+        timeNs = _rxTicksToTimeNs(state->heldTicks);
+        state->heldElems -= numHeld;
+        state->heldOffset += numHeld;
+        state->heldTicks += numHeld;
+        state->nextTicks = state->heldTicks;
+        total = numHeld;
     }
 
-    //actual count is number of samples in total all channels
-    numElems = md.actual_count / _rxChans.size();
-
-    //perform the int16 to float conversion
-    if (_rxFloats and _rxChans.size() == 1)
+    while (total < numElems)
     {
-        float *output = (float *)buffs[0];
-        for (size_t i = 0; i < 2 * numElems; i++)
+        const size_t chunk = std::min(numElems - total, state->buffSize);
+        void *outs[2];
+        for (size_t i = 0; i < numChans; i++) outs[i] = (char *)buffs[i] + total*state->formatBytes();
+
+        //initialize metadata
+        bladerf_metadata md;
+        std::memset(&md, 0, sizeof(md));
+
+        //without a soapy sdr time flag, set the blade rf now flag
+        //the following chunks continue where the previous one ended
+        if ((cmd.flags & SOAPY_SDR_HAS_TIME) == 0 or total > 0) md.flags |= BLADERF_META_FLAG_RX_NOW;
+        else md.timestamp = _timeNsToRxTicks(cmd.timeNs);
+
+        //recv the rx samples
+        void *samples = native?outs[0]:state->convBuff;
+        int ret = 0;
         {
-            output[i] = float(_rxConvBuff[i])/2048;
+            ScopedTimer blocked(state->stats.blockedNs);
+            ret = bladerf_sync_rx(_dev, samples, chunk*numChans, &md, timeoutMs);
         }
-    }
-    else if (not _rxFloats and _rxChans.size() == 2)
-    {
-        int16_t *output0 = (int16_t *)buffs[0];
-        int16_t *output1 = (int16_t *)buffs[1];
-        for (size_t i = 0; i < 4 * numElems;)
+
+        //clear flags for subsequent calls, a timed read that timed out waits for the same time again
+        if (ret != BLADERF_ERR_TIMEOUT) cmd.flags = 0;
+
+        //errors after the first chunk are left for the next call
+        if (ret != 0 and total > 0) break;
+        if (ret == BLADERF_ERR_TIMEOUT) return SOAPY_SDR_TIMEOUT;
+        if (ret == BLADERF_ERR_TIME_PAST) return SOAPY_SDR_TIME_ERROR;
+        if (ret != 0)
         {
-            *(output0++) = _rxConvBuff[i++];
-            *(output0++) = _rxConvBuff[i++];
-            *(output1++) = _rxConvBuff[i++];
-            *(output1++) = _rxConvBuff[i++];
+            //any error when this is a finite burst causes the command to be removed
+            if (cmd.numElems > 0) state->cmds.pop();
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_rx() returned %s", _err2str(ret).c_str());
+            return SOAPY_SDR_STREAM_ERROR;
         }
-    }
-    else if (_rxFloats and _rxChans.size() == 2)
-    {
-        float *output0 = (float *)buffs[0];
-        float *output1 = (float *)buffs[1];
-        for (size_t i = 0; i < 4 * numElems;)
+
+        //actual count is number of samples in total all channels
+        const size_t numRecv = md.actual_count / numChans;
+
+        //a chunk that does not follow the previous one ends the read, the gap is
+        //reported as an overflow on the next call and the chunk is held for the call after
+        if (total > 0 and meta and (long long)(md.timestamp) != state->nextTicks)
         {
-            *(output0++) = float(_rxConvBuff[i++])/2048;
-            *(output0++) = float(_rxConvBuff[i++])/2048;
-            *(output1++) = float(_rxConvBuff[i++])/2048;
-            *(output1++) = float(_rxConvBuff[i++])/2048;
+            if (native) std::memcpy(state->convBuff, samples, numRecv*state->elemBytes());
+            state->heldElems = numRecv;
+            state->heldOffset = 0;
+            state->heldTicks = md.timestamp;
+            state->overflow = true;
+            state->stats.overflows++;
+            break;
         }
-    }
 
-    //unpack the metadata
-    flags |= SOAPY_SDR_HAS_TIME;
-    timeNs = _rxTicksToTimeNs(md.timestamp);
+        //perform the int16 to float conversion
+        if (not native) this->convertRxSamples(state, state->convBuff, outs, numRecv);
 
-    //parse the status
-    if ((md.status & BLADERF_META_STATUS_OVERRUN) != 0)
-    {
-        SoapySDR::log(SOAPY_SDR_SSI, "0");
-        _rxOverflow = true;
+        //unpack the metadata
+        if (total == 0)
+        {
+            flags |= SOAPY_SDR_HAS_TIME;
+            timeNs = _rxTicksToTimeNs(md.timestamp);
+        }
+        state->nextTicks = md.timestamp + numRecv;
+        total += numRecv;
+
+        //add flags specific to BladeRF from bladerf_sync_rx.status.
+        #if defined(SOAPY_SDR_USER_FLAG0) and defined(SOAPY_SDR_USER_FLAG1)
+        if ((md.status & BLADERF_META_FLAG_RX_HW_MINIEXP1) != 0) flags |= SOAPY_SDR_USER_FLAG0;
+        if ((md.status & BLADERF_META_FLAG_RX_HW_MINIEXP2) != 0) flags |= SOAPY_SDR_USER_FLAG1;
+        #endif
+
+        //parse the status, the samples after an overrun are not contiguous
+        if ((md.status & BLADERF_META_STATUS_OVERRUN) != 0)
+        {
+            SoapySDR::log(SOAPY_SDR_SSI, "0");
+            state->overflow = true;
+            state->stats.overflows++;
+            break;
+        }
+        if (numRecv < chunk) break;
+
+        //low latency returns the first transfer rather than blocking for the rest
+        if (state->lowLatency) break;
     }
+    numElems = total;
 
-    //add flags specific to BladeRF from bladerf_sync_rx.status.
-    #if defined(SOAPY_SDR_USER_FLAG0) and defined(SOAPY_SDR_USER_FLAG1)
-    if ((md.status & BLADERF_META_FLAG_RX_HW_MINIEXP1) != 0) flags |= SOAPY_SDR_USER_FLAG0;
-    if ((md.status & BLADERF_META_FLAG_RX_HW_MINIEXP2) != 0) flags |= SOAPY_SDR_USER_FLAG1;
-    #endif
+    //the delivered timestamps keep the hardware time model from lagging
+    if (meta and total > 0) this->observeRxTicks(state->nextTicks);
 
     //consume from the command if this is a finite burst
     if (cmd.numElems > 0)
     {
         cmd.numElems -= numElems;
-        if (cmd.numElems == 0) _rxCmds.pop();
+        if (cmd.numElems == 0) state->cmds.pop();
     }
 
-    _rxNextTicks = md.timestamp + numElems;
     return numElems;
 }
 
-int bladeRF_SoapySDR::writeStream(
-    SoapySDR::Stream *,
-    const void * const *buffs,
-    size_t numElems,
-    int &flags,
-    const long long timeNs,
-    const long timeoutUs)
+void bladeRF_SoapySDR::convertRxSamples(StreamState *state, const void *in_, void * const *buffs, const size_t numElems)
 {
-    //clear EOB when the last sample will not be transmitted
-    if (numElems > _txBuffSize) flags &= ~(SOAPY_SDR_END_BURST);
-
-    //clip to the available conversion buffer size
-    numElems = std::min(numElems, _txBuffSize);
-
-    //initialize metadata
-    bladerf_metadata md;
-    std::memset(&md, 0, sizeof(md));
+    ScopedTimer timer(state->stats.convertNs);
+    const size_t numChans = state->chans.size();
 
-    //stream is already in a burst and a new time was provided
-    //update the metadata burst time with the provided time
-    if (_inTxBurst)
+    //8-bit wire samples, to the CS8, CF32, or Q11 scaled CS16 format
+    if (state->wire8)
     {
-        if ((flags & SOAPY_SDR_HAS_TIME) != 0)
+        const int8_t *in = (const int8_t *)in_;
+        if (state->cs8 and numChans == 1)
         {
-            md.timestamp = _timeNsToTxTicks(timeNs);
-            md.flags |= BLADERF_META_FLAG_TX_UPDATE_TIMESTAMP;
-            _txNextTicks = md.timestamp;
+            std::memcpy(buffs[0], in, numElems*2*sizeof(int8_t));
         }
-    }
-
-    //the stream is not in a burst, start a new one
-    else
-    {
-        md.flags |= BLADERF_META_FLAG_TX_BURST_START;
-        //use the metadata to start the burst and set a timestamp if provided
-        if ((flags & SOAPY_SDR_HAS_TIME) != 0)
+        else if (state->cs8 and numChans == 2)
         {
-            md.timestamp = _timeNsToTxTicks(timeNs);
-            _txNextTicks = md.timestamp;
+            deinterleaveCS8(in, (int8_t *)buffs[0], (int8_t *)buffs[1], numElems);
         }
-        //otherwise set now flag and record the rough time for reporting
-        else
+        else if (state->floats and numChans == 1)
         {
-            md.flags |= BLADERF_META_FLAG_TX_NOW;
-            bladerf_timestamp t;
-            bladerf_get_timestamp(_dev, BLADERF_TX, &t);
-            _txNextTicks = t;
+            convertCS8ToCF32(in, (float *)buffs[0], 2 * numElems);
         }
-    }
-
-    //end of burst
-    if ((flags & SOAPY_SDR_END_BURST) != 0)
-    {
-        md.flags |= BLADERF_META_FLAG_TX_BURST_END;
-    }
-
-    //prepare buffers
-    void *samples = (void *)buffs[0];
-    if (_txFloats or _txChans.size() == 2) samples = _txConvBuff;
-
-    //perform the float to int16 conversion
-    if (_txFloats and _txChans.size() == 1)
-    {
-        float *input = (float *)buffs[0];
-        for (size_t i = 0; i < 2 * numElems; i++)
+        else if (state->floats and numChans == 2)
         {
-            _txConvBuff[i] = int16_t(input[i]*2048);
+            deinterleaveCS8ToCF32(in, (float *)buffs[0], (float *)buffs[1], numElems);
         }
-    }
-    else if (not _txFloats and _txChans.size() == 2)
-    {
-        int16_t *input0 = (int16_t *)buffs[0];
-        int16_t *input1 = (int16_t *)buffs[1];
-        for (size_t i = 0; i < 4 * numElems;)
+        else if (numChans == 1)
         {
-            _txConvBuff[i++] = *(input0++);
-            _txConvBuff[i++] = *(input0++);
-            _txConvBuff[i++] = *(input1++);
-            _txConvBuff[i++] = *(input1++);
+            convertCS8ToCS16(in, (int16_t *)buffs[0], 2 * numElems);
         }
-    }
-    else if (_txFloats and _txChans.size() == 2)
-    {
-        float *input0 = (float *)buffs[0];
-        float *input1 = (float *)buffs[1];
-        for (size_t i = 0; i < 4 * numElems;)
+        else if (numChans == 2)
         {
-            _txConvBuff[i++] = int16_t(*(input0++)*2048);
-            _txConvBuff[i++] = int16_t(*(input0++)*2048);
-            _txConvBuff[i++] = int16_t(*(input1++)*2048);
-            _txConvBuff[i++] = int16_t(*(input1++)*2048);
+            deinterleaveCS8ToCS16(in, (int16_t *)buffs[0], (int16_t *)buffs[1], numElems);
         }
+        return;
     }
 
-    //send the tx samples
-    int ret = bladerf_sync_tx(_dev, samples, numElems*_txChans.size(), &md, timeoutUs/1000);
-    if (ret == BLADERF_ERR_TIMEOUT) return SOAPY_SDR_TIMEOUT;
-    if (ret == BLADERF_ERR_TIME_PAST) return SOAPY_SDR_TIME_ERROR;
-    if (ret != 0)
+    const int16_t *in = (const int16_t *)in_;
+    if (not state->floats and numChans == 1)
     {
-        SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_tx() returned %s", _err2str(ret).c_str());
-        return SOAPY_SDR_STREAM_ERROR;
+        std::memcpy(buffs[0], in, numElems*2*sizeof(int16_t));
     }
-    _txNextTicks += numElems;
-
-    //always in a burst after successful tx
-    _inTxBurst = true;
-
-    //parse the status
-    if ((md.status & BLADERF_META_STATUS_UNDERRUN) != 0)
+    else if (state->floats and numChans == 1)
     {
-        SoapySDR::log(SOAPY_SDR_SSI, "U");
-        StreamMetadata resp;
-        resp.flags = 0;
-        resp.code = SOAPY_SDR_UNDERFLOW;
-        _txResps.push(resp);
+        convertCS16ToCF32(in, (float *)buffs[0], 2 * numElems);
     }
-
-    //end burst status message
-    if ((flags & SOAPY_SDR_END_BURST) != 0)
+    else if (not state->floats and numChans == 2)
     {
-        StreamMetadata resp;
-        resp.flags = SOAPY_SDR_END_BURST | SOAPY_SDR_HAS_TIME;
-        resp.timeNs = this->_txTicksToTimeNs(_txNextTicks);
-        resp.code = 0;
-        _txResps.push(resp);
-        _inTxBurst = false;
+        deinterleaveCS16(in, (int16_t *)buffs[0], (int16_t *)buffs[1], numElems);
+    }
+    else if (state->floats and numChans == 2)
+    {
+        deinterleaveCS16ToCF32(in, (float *)buffs[0], (float *)buffs[1], numElems);
     }
+}
 
-    return numElems;
+/*******************************************************************
+ * RX reader thread ring
+ ******************************************************************/
+
+void bladeRF_SoapySDR::startRxRing(StreamState *state)
+{
+    RxRing *ring = state->rxRing;
+    if (ring->thread.joinable()) return;
+
+    ring->head = 0;
+    ring->tail = 0;
+    ring->offset = 0;
+    ring->done = false;
+    ring->thread = std::thread(&bladeRF_SoapySDR::rxRingLoop, this, state);
 }
 
-int bladeRF_SoapySDR::readStreamStatus(
-    SoapySDR::Stream *stream,
-    size_t &,
-    int &flags,
+void bladeRF_SoapySDR::stopRxRing(StreamState *state)
+{
+    RxRing *ring = state->rxRing;
+    if (not ring->thread.joinable()) return;
+
+    ring->done = true;
+    ring->thread.join();
+}
+
+void bladeRF_SoapySDR::rxRingLoop(StreamState *state)
+{
+    state->policy.apply("rx_thread");
+    RxRing *ring = state->rxRing;
+    const size_t numSlots = ring->slots.size();
+    const size_t numChans = state->chans.size();
+    std::vector<int16_t> scratch(ring->slots.front().buff.size());
+    bool overflow = false;
+
+    while (not ring->done)
+    {
+        const size_t head = ring->head.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) % numSlots;
+
+        //the ring is full: keep draining the device but drop the samples
+        const bool full = (next == ring->tail.load(std::memory_order_acquire));
+        RxSlot &slot = ring->slots[head];
+        int16_t *samples = full?scratch.data():slot.buff.data();
+
+        bladerf_metadata md;
+        std::memset(&md, 0, sizeof(md));
+        md.flags |= BLADERF_META_FLAG_RX_NOW;
+
+        //short timeouts so that stopRxRing() is responsive
+        int ret = 0;
+        {
+            ScopedTimer blocked(state->stats.blockedNs);
+            ret = bladerf_sync_rx(_dev, samples, state->buffSize*numChans, &md, std::max<long>(_rxMinTimeoutMs(state), 100));
+        }
+        if (ret == BLADERF_ERR_TIMEOUT) continue;
+        if (full)
+        {
+            overflow = true;
+            continue;
+        }
+
+        slot.ret = ret;
+        slot.timestamp = md.timestamp;
+        slot.numElems = md.actual_count / numChans;
+        slot.status = md.status;
+        if (overflow) slot.status |= BLADERF_META_STATUS_OVERRUN;
+        overflow = false;
+
+        //publish the slot and wake readStream() if it sleeps on an empty ring
+        ring->head.store(next);
+        ring->notify();
+
+        //errors are handed to readStream() and end the thread
+        if (ret != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_rx() returned %s", _err2str(ret).c_str());
+            break;
+        }
+    }
+}
+
+int bladeRF_SoapySDR::readStreamRing(
+    StreamState *state,
+    void * const *buffs,
+    size_t numElems,
+    int &flags,
+    long long &timeNs,
+    const long timeoutUs)
+{
+    RxRing *ring = state->rxRing;
+
+    //extract the front-most command
+    //no command, this is a timeout...
+    if (state->cmds.empty()) return SOAPY_SDR_TIMEOUT;
+    StreamMetadata &cmd = state->cmds.front();
+
+    //clear output metadata
+    flags = 0;
+    timeNs = 0;
+
+    //return overflow status indicator
+    if (state->overflow)
+    {
+        state->overflow = false;
+        flags |= SOAPY_SDR_HAS_TIME;
+        timeNs = _rxTicksToTimeNs(state->nextTicks);
+        return SOAPY_SDR_OVERFLOW;
+    }
+
+    if (cmd.numElems > 0) numElems = std::min(cmd.numElems, numElems);
+
+    //copy out of as many contiguous slots as the request spans
+    size_t total = 0;
+    const auto exitTime = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    while (total < numElems)
+    {
+        //sleep until the reader thread publishes a slot
+        bool ready = false;
+        {
+            ScopedTimer blocked(state->stats.blockedNs);
+            //low latency only takes the slots that are already published after the first
+            const auto waitTime = (state->lowLatency and total > 0)?std::chrono::steady_clock::now():exitTime;
+            ready = ring->waitUntil(waitTime, [ring]{return not ring->empty();});
+        }
+        if (not ready)
+        {
+            if (total > 0) break;
+            return SOAPY_SDR_TIMEOUT;
+        }
+
+        const size_t tail = ring->tail.load(std::memory_order_relaxed);
+        RxSlot &slot = ring->slots[tail];
+        const auto popSlot = [ring, tail](void)
+        {
+            ring->offset = 0;
+            ring->tail.store((tail + 1) % ring->slots.size(), std::memory_order_release);
+        };
+
+        //errors, overruns, and gaps after the first slot are left for the next call
+        if (total > 0 and ring->offset == 0 and (slot.ret != 0 or
+            (slot.status & BLADERF_META_STATUS_OVERRUN) != 0 or
+            slot.timestamp != state->nextTicks)) break;
+
+        if (slot.ret != 0)
+        {
+            popSlot();
+            if (slot.ret == BLADERF_ERR_TIME_PAST) return SOAPY_SDR_TIME_ERROR;
+            //any error when this is a finite burst causes the command to be removed
+            if (cmd.numElems > 0) state->cmds.pop();
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+
+        //parse the status once per slot
+        if (ring->offset == 0 and (slot.status & BLADERF_META_STATUS_OVERRUN) != 0)
+        {
+            SoapySDR::log(SOAPY_SDR_SSI, "0");
+            state->overflow = true;
+            state->stats.overflows++;
+        }
+
+        //a timed command discards the samples before the requested time
+        if ((cmd.flags & SOAPY_SDR_HAS_TIME) != 0)
+        {
+            const long long cmdTicks = _timeNsToRxTicks(cmd.timeNs);
+            if (cmdTicks >= slot.timestamp + (long long)(slot.numElems))
+            {
+                popSlot();
+                if (std::chrono::steady_clock::now() > exitTime) return SOAPY_SDR_TIMEOUT;
+                continue;
+            }
+            if (cmdTicks > slot.timestamp + (long long)(ring->offset)) ring->offset = size_t(cmdTicks - slot.timestamp);
+        }
+        cmd.flags = 0; //clear flags for subsequent calls
+
+        //copy out of the slot, possibly leaving a remainder for the next call
+        const size_t offset = ring->offset;
+        const size_t numCopy = std::min(numElems - total, slot.numElems - offset);
+        void *outs[2];
+        for (size_t i = 0; i < state->chans.size(); i++) outs[i] = (char *)buffs[i] + total*state->formatBytes();
+        this->convertRxSamples(state, (const char *)slot.buff.data() + offset*state->elemBytes(), outs, numCopy);
+
+        //unpack the metadata
+        if (total == 0)
+        {
+            flags |= SOAPY_SDR_HAS_TIME;
+            timeNs = _rxTicksToTimeNs(slot.timestamp + offset);
+        }
+
+        //add flags specific to BladeRF from bladerf_sync_rx.status.
+        #if defined(SOAPY_SDR_USER_FLAG0) and defined(SOAPY_SDR_USER_FLAG1)
+        if ((slot.status & BLADERF_META_FLAG_RX_HW_MINIEXP1) != 0) flags |= SOAPY_SDR_USER_FLAG0;
+        if ((slot.status & BLADERF_META_FLAG_RX_HW_MINIEXP2) != 0) flags |= SOAPY_SDR_USER_FLAG1;
+        #endif
+
+        state->nextTicks = slot.timestamp + offset + numCopy;
+        ring->offset += numCopy;
+        if (ring->offset == slot.numElems) popSlot();
+        total += numCopy;
+    }
+    numElems = total;
+
+    //the delivered timestamps keep the hardware time model from lagging
+    const bool meta = (state->syncFormat == BLADERF_FORMAT_SC16_Q11_META or state->syncFormat == BLADERF_FORMAT_SC8_Q7_META);
+    if (meta and total > 0) this->observeRxTicks(state->nextTicks);
+
+    //consume from the command if this is a finite burst
+    if (cmd.numElems > 0)
+    {
+        cmd.numElems -= numElems;
+        if (cmd.numElems == 0) state->cmds.pop();
+    }
+
+    return numElems;
+}
+
+int bladeRF_SoapySDR::writeStream(
+    SoapySDR::Stream *stream,
+    const void * const *buffs,
+    const size_t numElems,
+    int &flags,
+    const long long timeNs,
+    const long timeoutUs)
+{
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
+
+    //direct access streams use acquireWriteBuffer(), replay streams send their file
+    if (state->async != nullptr or state->replay != nullptr) return SOAPY_SDR_NOT_SUPPORTED;
+
+    //samples are sent by the writer thread or directly to libbladeRF
+    ScopedTimer timer(state->stats);
+    const int ret = (state->txRing != nullptr)?
+        this->writeStreamRing(state, buffs, numElems, flags, timeNs, timeoutUs):
+        this->writeStreamSync(state, buffs, numElems, flags, timeNs, timeoutUs);
+    this->countStreamResult(state, ret);
+    return ret;
+}
+
+int bladeRF_SoapySDR::writeStreamSync(
+    StreamState *state,
+    const void * const *buffs,
+    size_t numElems,
+    int &flags,
+    const long long timeNs,
+    const long timeoutUs)
+{
+    //send one buffer at a time, the time applies to the first
+    //and the end of burst to the last buffer of the request,
+    //an empty request is still sent to carry a lone end of burst
+    size_t total = 0;
+    do
+    {
+        const size_t chunk = std::min(numElems - total, state->buffSize);
+        const void *ins[2];
+        for (size_t i = 0; i < state->chans.size(); i++) ins[i] = (const char *)buffs[i] + total*state->formatBytes();
+        int chunkFlags = flags;
+        if (total > 0) chunkFlags &= ~(SOAPY_SDR_HAS_TIME);
+        if (total + chunk < numElems) chunkFlags &= ~(SOAPY_SDR_END_BURST);
+
+        //prepare buffers and send
+        const void *samples = this->convertTxSamples(state, ins, state->convBuff, chunk);
+        const int ret = this->sendTxSamples(state, samples, chunk, chunkFlags, timeNs, timeoutUs/1000);
+        if (ret != 0 and total == 0) return ret;
+        if (ret != 0) break;
+        total += chunk;
+    }
+    while (total < numElems);
+
+    //clear EOB when the last sample was not transmitted
+    if (total < numElems) flags &= ~(SOAPY_SDR_END_BURST);
+    return total;
+}
+
+const void *bladeRF_SoapySDR::convertTxSamples(StreamState *state, const void * const *buffs, void *out_, const size_t numElems)
+{
+    ScopedTimer timer(state->stats.convertNs);
+    const size_t numChans = state->chans.size();
+
+    //CS8, CF32, or Q11 scaled CS16 format to 8-bit wire samples
+    if (state->wire8)
+    {
+        int8_t *out = (int8_t *)out_;
+        if (state->cs8 and numChans == 1)
+        {
+            return buffs[0];
+        }
+        else if (state->cs8 and numChans == 2)
+        {
+            interleaveCS8((const int8_t *)buffs[0], (const int8_t *)buffs[1], out, numElems);
+        }
+        else if (state->floats and numChans == 1)
+        {
+            convertCF32ToCS8((const float *)buffs[0], out, 2 * numElems);
+        }
+        else if (state->floats and numChans == 2)
+        {
+            interleaveCF32ToCS8((const float *)buffs[0], (const float *)buffs[1], out, numElems);
+        }
+        else if (numChans == 1)
+        {
+            convertCS16ToCS8((const int16_t *)buffs[0], out, 2 * numElems);
+        }
+        else if (numChans == 2)
+        {
+            interleaveCS16ToCS8((const int16_t *)buffs[0], (const int16_t *)buffs[1], out, numElems);
+        }
+        return out;
+    }
+
+    //perform the float to int16 conversion
+    int16_t *out = (int16_t *)out_;
+    if (not state->floats and numChans == 1)
+    {
+        return buffs[0];
+    }
+    else if (state->floats and numChans == 1)
+    {
+        convertCF32ToCS16((const float *)buffs[0], out, 2 * numElems);
+    }
+    else if (not state->floats and numChans == 2)
+    {
+        interleaveCS16((const int16_t *)buffs[0], (const int16_t *)buffs[1], out, numElems);
+    }
+    else if (state->floats and numChans == 2)
+    {
+        interleaveCF32ToCS16((const float *)buffs[0], (const float *)buffs[1], out, numElems);
+    }
+    return out;
+}
+
+int bladeRF_SoapySDR::sendTxSamples(
+    StreamState *state,
+    const void *samples,
+    const size_t numElems,
+    const int flags,
+    const long long timeNs,
+    const long timeoutMs)
+{
+    //initialize metadata
+    bladerf_metadata md;
+    std::memset(&md, 0, sizeof(md));
+
+    //stream is already in a burst and a new time was provided
+    //update the metadata burst time with the provided time
+    if (state->inBurst)
+    {
+        if ((flags & SOAPY_SDR_HAS_TIME) != 0)
+        {
+            md.timestamp = _timeNsToTxTicks(timeNs);
+            md.flags |= BLADERF_META_FLAG_TX_UPDATE_TIMESTAMP;
+            state->nextTicks = md.timestamp;
+        }
+    }
+
+    //the stream is not in a burst, start a new one
+    else
+    {
+        md.flags |= BLADERF_META_FLAG_TX_BURST_START;
+        //use the metadata to start the burst and set a timestamp if provided
+        if ((flags & SOAPY_SDR_HAS_TIME) != 0)
+        {
+            md.timestamp = _timeNsToTxTicks(timeNs);
+            state->nextTicks = md.timestamp;
+        }
+        //otherwise set now flag and record the rough time for reporting
+        else
+        {
+            md.flags |= BLADERF_META_FLAG_TX_NOW;
+            bladerf_timestamp t;
+            bladerf_get_timestamp(_dev, BLADERF_TX, &t);
+            state->nextTicks = t;
+        }
+    }
+
+    //end of burst
+    if ((flags & SOAPY_SDR_END_BURST) != 0)
+    {
+        md.flags |= BLADERF_META_FLAG_TX_BURST_END;
+    }
+
+    //send the tx samples
+    int ret = 0;
+    {
+        ScopedTimer blocked(state->stats.blockedNs);
+        ret = bladerf_sync_tx(_dev, samples, numElems*state->chans.size(), &md, timeoutMs);
+    }
+    if (ret == BLADERF_ERR_TIMEOUT) return SOAPY_SDR_TIMEOUT;
+    if (ret == BLADERF_ERR_TIME_PAST) return SOAPY_SDR_TIME_ERROR;
+    if (ret != 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_tx() returned %s", _err2str(ret).c_str());
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    state->nextTicks += numElems;
+
+    //always in a burst after successful tx
+    state->inBurst = true;
+
+    //parse the status
+    if ((md.status & BLADERF_META_STATUS_UNDERRUN) != 0)
+    {
+        SoapySDR::log(SOAPY_SDR_SSI, "U");
+        StreamMetadata resp;
+        resp.flags = 0;
+        resp.code = SOAPY_SDR_UNDERFLOW;
+        this->pushTxResp(state, resp);
+    }
+
+    //end burst status message
+    if ((flags & SOAPY_SDR_END_BURST) != 0)
+    {
+        StreamMetadata resp;
+        resp.flags = SOAPY_SDR_END_BURST | SOAPY_SDR_HAS_TIME;
+        resp.timeNs = this->_txTicksToTimeNs(state->nextTicks);
+        resp.code = 0;
+        this->pushTxResp(state, resp);
+        state->inBurst = false;
+    }
+
+    return 0;
+}
+
+void bladeRF_SoapySDR::pushTxResp(StreamState *state, const StreamMetadata &resp)
+{
+    if (resp.code == SOAPY_SDR_UNDERFLOW) state->stats.underflows++;
+    if (resp.code == SOAPY_SDR_TIME_ERROR) state->stats.timeErrors++;
+    {
+        std::lock_guard<std::mutex> lock(state->respsMutex);
+        state->resps.push(resp);
+    }
+    state->respsCond.notify_all();
+}
+
+std::chrono::steady_clock::time_point bladeRF_SoapySDR::txTimeNsToClock(StreamState *state, const long long timeNs) const
+{
+    //one hardware time read per activation, the tick counter and host clock advance together after that
+    if (not state->clockValid)
+    {
+        state->clockTime = std::chrono::steady_clock::now();
+        state->clockTimeNs = this->getHardwareTime();
+        state->clockValid = true;
+    }
+    return state->clockTime + std::chrono::nanoseconds(timeNs - state->clockTimeNs);
+}
+
+void bladeRF_SoapySDR::invalidateTxClock(void)
+{
+    std::lock_guard<std::mutex> lock(_syncStreamMutex);
+    if (_txSyncStream != nullptr) _txSyncStream->clockValid = false;
+}
+
+/*******************************************************************
+ * RX record to file
+ ******************************************************************/
+
+void bladeRF_SoapySDR::startRecorder(StreamState *state, const int flags, const long long timeNs, const size_t numElems)
+{
+    RxRecorder *rec = state->recorder;
+    if (rec->thread.joinable())
+    {
+        //a finished recording continues in the same file
+        {
+            std::lock_guard<std::mutex> lock(rec->mutex);
+            if (rec->running) return;
+        }
+        rec->thread.join();
+    }
+
+    rec->startTicks = ((flags & SOAPY_SDR_HAS_TIME) != 0)?this->_timeNsToRxTicks(timeNs):-1;
+    rec->maxSamples = ((flags & SOAPY_SDR_END_BURST) != 0)?numElems:0;
+    rec->done = false;
+    rec->status = 0;
+    rec->running = true;
+    rec->thread = std::thread(&bladeRF_SoapySDR::recordLoop, this, state);
+}
+
+void bladeRF_SoapySDR::stopRecorder(StreamState *state)
+{
+    RxRecorder *rec = state->recorder;
+    if (not rec->thread.joinable()) return;
+
+    rec->done = true;
+    rec->thread.join();
+}
+
+void bladeRF_SoapySDR::recordLoop(StreamState *state)
+{
+    state->policy.apply("record thread");
+    RxRecorder *rec = state->recorder;
+    RecordFile *file = rec->file;
+    const size_t numChans = state->chans.size();
+    const size_t elemBytes = state->elemBytes();
+    unsigned long long total = 0;
+    long long startTicks = rec->startTicks;
+    int status = 0;
+
+    try
+    {
+        while (not rec->done)
+        {
+            //stop at the end of the file or of the burst
+            size_t numElems = file->room()/elemBytes;
+            if (rec->maxSamples != 0) numElems = size_t(std::min<unsigned long long>(numElems, rec->maxSamples - total));
+            if (numElems == 0) break;
+
+            //a timed activation waits for its first sample, the rest follows on
+            bladerf_metadata md;
+            std::memset(&md, 0, sizeof(md));
+            if (startTicks >= 0) md.timestamp = bladerf_timestamp(startTicks);
+            else md.flags |= BLADERF_META_FLAG_RX_NOW;
+
+            //short timeouts so that stopRecorder() is responsive
+            int ret = 0;
+            {
+                ScopedTimer blocked(state->stats.blockedNs);
+                ret = bladerf_sync_rx(_dev, file->next(), numElems*numChans, &md, std::max<long>(_rxMinTimeoutMs(state), 100));
+            }
+            if (ret == BLADERF_ERR_TIMEOUT) continue;
+            if (ret != 0)
+            {
+                SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_sync_rx() returned %s", _err2str(ret).c_str());
+                status = (ret == BLADERF_ERR_TIME_PAST)?SOAPY_SDR_TIME_ERROR:SOAPY_SDR_STREAM_ERROR;
+                break;
+            }
+            startTicks = -1;
+
+            const size_t got = md.actual_count/numChans;
+            const bool overrun = (md.status & BLADERF_META_STATUS_OVERRUN) != 0;
+            if (overrun) state->stats.overflows++;
+            state->stats.samples += got;
+            file->commit(got*elemBytes, md.timestamp, this->_rxTicksToTimeNs(md.timestamp), overrun);
+            this->observeRxTicks(md.timestamp + got);
+            total += got;
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "recordLoop() %s", ex.what());
+        status = SOAPY_SDR_STREAM_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(rec->mutex);
+    rec->status = status;
+    rec->running = false;
+    rec->cond.notify_all();
+}
+
+int bladeRF_SoapySDR::readStreamRecord(StreamState *state, int &flags, const long timeoutUs)
+{
+    RxRecorder *rec = state->recorder;
+    std::unique_lock<std::mutex> lock(rec->mutex);
+    flags = 0;
+
+    if (not rec->cond.wait_for(lock, std::chrono::microseconds(timeoutUs), [rec]{return not rec->running;}))
+    {
+        return SOAPY_SDR_TIMEOUT;
+    }
+    if (rec->status != 0) return rec->status;
+
+    //the file or the burst is complete
+    flags |= SOAPY_SDR_END_BURST;
+    return 0;
+}
+
+/*******************************************************************
+ * RX scan
+ ******************************************************************/
+
+void bladeRF_SoapySDR::startScan(StreamState *state, const int flags, const long long timeNs)
+{
+    RxScan *scan = state->scan;
+    while (not state->cmds.empty()) state->cmds.pop();
+    scan->pending.clear();
+    scan->scheduled = 0;
+    scan->offset = 0;
+    scan->tunedFrequency = NAN;
+    scan->tunedNs = 0;
+    state->overflow = false;
+
+    //an untimed start is moved to the earliest retune time by refillScan()
+    scan->nextTicks = ((flags & SOAPY_SDR_HAS_TIME) != 0)?_timeNsToRxTicks(timeNs):0;
+    this->refillScan(state);
+}
+
+void bladeRF_SoapySDR::refillScan(StreamState *state)
+{
+    RxScan *scan = state->scan;
+    const size_t numSteps = scan->steps.size();
+    if (scan->pending.size() >= SCAN_LOOKAHEAD) return;
+
+    //a reader that fell behind moves the dwell grid forward instead of retuning in the past
+    try
+    {
+        const long long earliest = _timeNsToRxTicks(this->getHardwareTime() + SCAN_LEAD_NS);
+        if (scan->nextTicks < earliest) scan->nextTicks = earliest;
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR::logf(SOAPY_SDR_WARNING, "refillScan() %s", ex.what());
+    }
+
+    std::vector<HopCommand> hops;
+    while (scan->pending.size() < SCAN_LOOKAHEAD and (scan->loop or scan->scheduled < numSteps))
+    {
+        const RxScan::Step &step = scan->steps[scan->scheduled % numSteps];
+        const long long retuneNs = _rxTicksToTimeNs(scan->nextTicks);
+
+        //the channels share the LO, one retune moves all of them
+        HopCommand hop;
+        hop.direction = SOAPY_SDR_RX;
+        hop.timeNs = retuneNs;
+        hop.frequency = NAN;
+        hop.gain = step.gain;
+        const bool retune = step.frequency != scan->tunedFrequency;
+        for (size_t i = 0; i < state->chans.size(); i++)
+        {
+            hop.channel = state->chans[i];
+            hop.frequency = (i == 0 and retune)?step.frequency:NAN;
+            if (not std::isnan(hop.frequency) or not std::isnan(hop.gain)) hops.push_back(hop);
+        }
+        scan->tunedFrequency = step.frequency;
+        if (retune) scan->tunedNs = retuneNs;
+
+        RxScan::Dwell dwell;
+        dwell.block.step = size_t(scan->scheduled % numSteps);
+        dwell.block.sweep = size_t(scan->scheduled / numSteps);
+        dwell.block.frequency = step.frequency;
+        dwell.block.gain = step.gain;
+        dwell.block.timeNs = _rxTicksToTimeNs(scan->nextTicks + (long long)(scan->settle));
+        dwell.block.offset = 0;
+        dwell.retuneNs = scan->tunedNs;
+        dwell.gainNs = std::isnan(step.gain)?0:retuneNs;
+        scan->pending.push_back(dwell);
+
+        StreamMetadata cmd;
+        cmd.flags = SOAPY_SDR_HAS_TIME;
+        cmd.timeNs = dwell.block.timeNs;
+        cmd.numElems = scan->dwell;
+        cmd.code = 0;
+        state->cmds.push(cmd);
+
+        scan->scheduled++;
+        scan->nextTicks += (long long)(scan->settle + scan->dwell);
+    }
+
+    if (not hops.empty()) this->scheduleHops(hops);
+}
+
+void bladeRF_SoapySDR::stopScan(StreamState *state)
+{
+    RxScan *scan = state->scan;
+    while (not state->cmds.empty()) state->cmds.pop();
+    scan->pending.clear();
+
+    //the hop schedule belongs to the scan while it runs
+    this->clearHops();
+    for (const auto ch : state->chans)
+    {
+        const int ret = bladerf_cancel_scheduled_retunes(_dev, BLADERF_CHANNEL_RX(ch));
+        if (ret != 0) SoapySDR::logf(SOAPY_SDR_WARNING, "bladerf_cancel_scheduled_retunes() returned %s", _err2str(ret).c_str());
+    }
+}
+
+int bladeRF_SoapySDR::readScan(
+    SoapySDR::Stream *stream,
+    void * const *buffs,
+    const size_t numElems,
+    int &flags,
+    ScanBlock &block,
+    const long timeoutUs)
+{
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
+    if (state->scan == nullptr) return SOAPY_SDR_NOT_SUPPORTED;
+
+    ScopedTimer timer(state->stats);
+    long long timeNs = 0;
+    const int ret = this->readStreamScan(state, buffs, numElems, flags, timeNs, timeoutUs, &block);
+    this->countStreamResult(state, ret);
+    return ret;
+}
+
+int bladeRF_SoapySDR::readStreamScan(
+    StreamState *state,
+    void * const *buffs,
+    const size_t numElems,
+    int &flags,
+    long long &timeNs,
+    const long timeoutUs,
+    ScanBlock *block)
+{
+    RxScan *scan = state->scan;
+    flags = 0;
+
+    //a single sweep that has been delivered
+    if (scan->pending.empty()) return SOAPY_SDR_TIMEOUT;
+    const RxScan::Dwell dwell = scan->pending.front();
+
+    const int ret = this->readStreamSync(state, buffs, numElems, flags, timeNs, timeoutUs);
+
+    //a dwell with a gap, or one that starts before the stream position, is dropped whole
+    if ((ret == SOAPY_SDR_OVERFLOW and scan->offset > 0) or ret == SOAPY_SDR_TIME_ERROR)
+    {
+        if (not state->cmds.empty()) state->cmds.pop();
+        scan->pending.pop_front();
+        scan->offset = 0;
+        this->refillScan(state);
+        flags = SOAPY_SDR_HAS_TIME;
+        timeNs = dwell.block.timeNs;
+        return SOAPY_SDR_OVERFLOW;
+    }
+    if (ret <= 0) return ret;
+
+    //the samples of a dwell whose hop was dropped do not match its tags,
+    //the dwell is dropped whole and the next retune is forced
+    if (scan->offset == 0 and
+        ((dwell.retuneNs != 0 and this->hopMissed(SOAPY_SDR_RX, dwell.retuneNs)) or
+        (dwell.gainNs != 0 and this->hopMissed(SOAPY_SDR_RX, dwell.gainNs))))
+    {
+        if (size_t(ret) < scan->dwell and not state->cmds.empty()) state->cmds.pop();
+        scan->pending.pop_front();
+        scan->tunedFrequency = NAN;
+        this->refillScan(state);
+        if (block != nullptr) *block = dwell.block;
+        flags = SOAPY_SDR_HAS_TIME;
+        timeNs = dwell.block.timeNs;
+        return SOAPY_SDR_CORRUPTION;
+    }
+
+    if (block != nullptr)
+    {
+        *block = dwell.block;
+        block->offset = scan->offset;
+    }
+
+    //the dwell is complete when its command has been consumed
+    scan->offset += size_t(ret);
+    if (scan->offset >= scan->dwell)
+    {
+        flags |= SOAPY_SDR_END_BURST;
+        scan->pending.pop_front();
+        scan->offset = 0;
+        this->refillScan(state);
+    }
+    return ret;
+}
+
+/*******************************************************************
+ * TX replay from file
+ ******************************************************************/
+
+void bladeRF_SoapySDR::startReplay(StreamState *state, const int flags, const long long timeNs)
+{
+    TxReplay *replay = state->replay;
+    if (replay->thread.joinable()) replay->thread.join(); //a finished replay starts over
+
+    replay->flags = flags;
+    replay->timeNs = timeNs;
+    replay->done = false;
+    replay->thread = std::thread(&bladeRF_SoapySDR::replayLoop, this, state);
+}
+
+void bladeRF_SoapySDR::stopReplay(StreamState *state)
+{
+    TxReplay *replay = state->replay;
+    if (not replay->thread.joinable()) return;
+
+    replay->done = true;
+    replay->thread.join();
+}
+
+void bladeRF_SoapySDR::replayLoop(StreamState *state)
+{
+    state->policy.apply("replay thread");
+    TxReplay *replay = state->replay;
+    const char *samples = (const char *)replay->file->data();
+    const size_t elemBytes = state->elemBytes();
+    const size_t totalElems = replay->file->size()/elemBytes;
+    int flags = replay->flags;
+    size_t offset = 0; //in samples
+
+    while (not replay->done)
+    {
+        //chunks stop at the end of the file, so a loop continues the burst from the start
+        const size_t numElems = std::min(state->buffSize, totalElems - offset);
+        const bool last = (offset + numElems == totalElems) and not replay->loop;
+        if (last) flags |= SOAPY_SDR_END_BURST;
+
+        //libbladeRF blocks until a timed burst starts, so wait past the start time
+        long timeoutMs = 100;
+        if ((flags & SOAPY_SDR_HAS_TIME) != 0)
+        {
+            try {timeoutMs += long(std::max(0LL, replay->timeNs - this->getHardwareTime())/1000000);}
+            catch (const std::exception &) {}
+        }
+
+        //retry timeouts, the burst continues where it stopped
+        int ret = 0;
+        do ret = this->sendTxSamples(state, samples + offset*elemBytes, numElems, flags, replay->timeNs, timeoutMs);
+        while (ret == SOAPY_SDR_TIMEOUT and not replay->done);
+        if (ret == SOAPY_SDR_TIMEOUT) break;
+        if (ret < 0)
+        {
+            StreamMetadata resp;
+            resp.flags = 0;
+            resp.code = ret;
+            this->pushTxResp(state, resp);
+            break;
+        }
+        state->stats.samples += numElems;
+
+        flags = 0;
+        offset += numElems;
+        if (last) break;
+        if (offset == totalElems) offset = 0;
+    }
+}
+
+/*******************************************************************
+ * TX writer thread ring
+ ******************************************************************/
+
+void bladeRF_SoapySDR::startTxRing(StreamState *state)
+{
+    TxRing *ring = state->txRing;
+    if (ring->thread.joinable()) return;
+
+    ring->head = 0;
+    ring->tail = 0;
+    ring->done = false;
+    ring->thread = std::thread(&bladeRF_SoapySDR::txRingLoop, this, state);
+}
+
+void bladeRF_SoapySDR::stopTxRing(StreamState *state)
+{
+    TxRing *ring = state->txRing;
+    if (not ring->thread.joinable()) return;
+
+    //the writer thread sends everything queued before exiting
+    ring->done = true;
+    {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        ring->cond.notify_all();
+    }
+    ring->thread.join();
+}
+
+void bladeRF_SoapySDR::txRingLoop(StreamState *state)
+{
+    state->policy.apply("tx_thread");
+    TxRing *ring = state->txRing;
+    const size_t numSlots = ring->slots.size();
+
+    while (true)
+    {
+        //wait on the producer, the timeout re-checks the done flag
+        const auto pollTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+        if (ring->empty())
+        {
+            if (ring->done) break;
+            ring->waitUntil(pollTime, [ring]{return not ring->empty() or ring->done;});
+            continue;
+        }
+
+        //before starting a burst, pre-fill the ring up to the lead depth
+        //so that the start of the burst is covered by queued samples;
+        //timed bursts, end of burst, or a stalled producer start at once
+        if (not state->inBurst and not ring->done)
+        {
+            const TxSlot &front = ring->slots[ring->tail.load()];
+            const size_t queued = ring->size();
+            const bool timed = (front.flags & SOAPY_SDR_HAS_TIME) != 0;
+            const bool ending = (ring->slots[(ring->head.load() + numSlots - 1) % numSlots].flags & SOAPY_SDR_END_BURST) != 0;
+            if (queued < state->txRingLead and not timed and not ending)
+            {
+                if (ring->waitUntil(pollTime, [ring, queued]{return ring->size() > queued or ring->done;})) continue;
+            }
+        }
+
+        const size_t tail = ring->tail.load(std::memory_order_relaxed);
+        const TxSlot &slot = ring->slots[tail];
+
+        //retry timeouts, the caller has already been told the samples were accepted
+        int ret = 0;
+        do ret = this->sendTxSamples(state, slot.buff.data(), slot.numElems, slot.flags, slot.timeNs, 100/*ms*/);
+        while (ret == SOAPY_SDR_TIMEOUT and not ring->done);
+        if (ret != 0)
+        {
+            StreamMetadata resp;
+            resp.flags = 0;
+            resp.code = ret;
+            this->pushTxResp(state, resp);
+        }
+
+        //release the slot to the producer
+        ring->tail.store((tail + 1) % numSlots, std::memory_order_release);
+        ring->notify();
+    }
+}
+
+int bladeRF_SoapySDR::writeStreamRing(
+    StreamState *state,
+    const void * const *buffs,
+    size_t numElems,
+    int &flags,
+    const long long timeNs,
+    const long timeoutUs)
+{
+    TxRing *ring = state->txRing;
+
+    //fill as many slots as the request spans, at least one for a lone end of burst
+    size_t total = 0;
+    const auto exitTime = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    do
+    {
+        //wait for the writer thread to free a slot
+        bool ready = false;
+        {
+            ScopedTimer blocked(state->stats.blockedNs);
+            ready = ring->waitUntil(exitTime, [ring]{return not ring->full();});
+        }
+        if (not ready)
+        {
+            if (total > 0) break;
+            return SOAPY_SDR_TIMEOUT;
+        }
+
+        //convert into the slot, native samples are copied
+        const size_t chunk = std::min(numElems - total, state->buffSize);
+        const void *ins[2];
+        for (size_t i = 0; i < state->chans.size(); i++) ins[i] = (const char *)buffs[i] + total*state->formatBytes();
+        const size_t head = ring->head.load(std::memory_order_relaxed);
+        TxSlot &slot = ring->slots[head];
+        const void *samples = this->convertTxSamples(state, ins, slot.buff.data(), chunk);
+        if (samples != slot.buff.data()) std::memcpy(slot.buff.data(), samples, chunk*state->elemBytes());
+        slot.numElems = chunk;
+        slot.flags = flags;
+        if (total > 0) slot.flags &= ~(SOAPY_SDR_HAS_TIME);
+        if (total + chunk < numElems) slot.flags &= ~(SOAPY_SDR_END_BURST);
+        slot.timeNs = timeNs;
+
+        //publish the slot to the writer thread
+        ring->head.store((head + 1) % ring->slots.size());
+        ring->notify();
+        total += chunk;
+    }
+    while (total < numElems);
+
+    //clear EOB when the last sample was not queued
+    if (total < numElems) flags &= ~(SOAPY_SDR_END_BURST);
+    return total;
+}
+
+int bladeRF_SoapySDR::readStreamStatus(
+    SoapySDR::Stream *stream,
+    size_t &,
+    int &flags,
     long long &timeNs,
     const long timeoutUs
 )
 {
-    const int direction = *reinterpret_cast<int *>(stream);
-    if (direction == SOAPY_SDR_RX) return SOAPY_SDR_NOT_SUPPORTED;
+    StreamState *state = reinterpret_cast<StreamState *>(stream);
+    if (state->direction == SOAPY_SDR_RX) return SOAPY_SDR_NOT_SUPPORTED;
 
-    //wait for an event to be ready considering the timeout and time
-    //this is an emulation by polling and waiting on the hardware time
-    const auto exitTime = std::chrono::high_resolution_clock::now() + std::chrono::microseconds(timeoutUs);
+    //the tx paths notify on every response, timed responses are held until
+    //their time passes on the local clock rather than polling the hardware
+    const auto exitTime = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    std::unique_lock<std::mutex> lock(state->respsMutex);
     while (true)
     {
-        //no status to report, sleep for a bit
-        if (_txResps.empty()) goto pollSleep;
+        //no status to report, wait for one
+        if (state->resps.empty())
+        {
+            if (not state->respsCond.wait_until(lock, exitTime, [state]{return not state->resps.empty();})) return SOAPY_SDR_TIMEOUT;
+        }
 
         //no time on the current status, done waiting...
-        if ((_txResps.front().flags & SOAPY_SDR_HAS_TIME) == 0) break;
+        const StreamMetadata front = state->resps.front();
+        if ((front.flags & SOAPY_SDR_HAS_TIME) == 0) break;
 
         //current status time expired, done waiting...
-        if (_txResps.front().timeNs < this->getHardwareTime()) break;
-
-        //sleep a bit, never more than time remaining
-        pollSleep:
-        auto timeNow = std::chrono::high_resolution_clock::now();
-        auto timeLeft = std::chrono::duration_cast<std::chrono::microseconds>(exitTime - timeNow);
-        std::this_thread::sleep_for(std::chrono::microseconds(std::min<long>(1000, timeLeft.count())));
+        //the first use after activation reads the hardware time, not under the lock
+        std::chrono::steady_clock::time_point expiry;
+        if (state->clockValid) expiry = this->txTimeNsToClock(state, front.timeNs);
+        else
+        {
+            lock.unlock();
+            this->txTimeNsToClock(state, front.timeNs);
+            lock.lock();
+            continue;
+        }
+        if (expiry <= std::chrono::steady_clock::now()) break;
 
-        //check for timeout expired
-        if (exitTime < std::chrono::high_resolution_clock::now()) return SOAPY_SDR_TIMEOUT;
+        //sleep until the status expires or the timeout
+        if (exitTime <= std::chrono::steady_clock::now()) return SOAPY_SDR_TIMEOUT;
+        state->respsCond.wait_until(lock, std::min(expiry, exitTime));
     }
 
     //extract the most recent status event
-    if (_txResps.empty()) return SOAPY_SDR_TIMEOUT;
-    StreamMetadata resp = _txResps.front();
-    _txResps.pop();
+    StreamMetadata resp = state->resps.front();
+    state->resps.pop();
+    lock.unlock();
 
     //load the output from the response
     flags = resp.flags;
     timeNs = resp.timeNs;
     return resp.code;
 }
+
+std::string bladeRF_SoapySDR::readStreamStats(const int direction) const
+{
+    std::lock_guard<std::mutex> lock(_syncStreamMutex);
+    const StreamState *state = (direction == SOAPY_SDR_RX)?_rxSyncStream:_txSyncStream;
+    if (state == nullptr) return "";
+    const StreamStats &stats = state->stats;
+
+    //estimate percentiles from the histogram as the upper bound of a bin
+    unsigned long long counts[STREAM_LATENCY_BINS];
+    unsigned long long calls = 0;
+    for (size_t i = 0; i < STREAM_LATENCY_BINS; i++) calls += (counts[i] = stats.latency[i]);
+    const auto percentile = [&counts, calls](const double p)
+    {
+        unsigned long long sum = 0;
+        for (size_t i = 0; i < STREAM_LATENCY_BINS; i++)
+        {
+            sum += counts[i];
+            if (sum > 0 and sum >= p*calls) return 2ull << i;
+        }
+        return 0ull;
+    };
+
+    std::string hist;
+    for (size_t i = 0; i < STREAM_LATENCY_BINS; i++)
+    {
+        if (counts[i] == 0) continue;
+        if (not hist.empty()) hist += " ";
+        hist += std::to_string(2ull << i) + ":" + std::to_string(counts[i]);
+    }
+
+    std::string out;
+    out += "samples=" + std::to_string(stats.samples.load());
+    out += ", overflows=" + std::to_string(stats.overflows.load());
+    out += ", underflows=" + std::to_string(stats.underflows.load());
+    out += ", timeouts=" + std::to_string(stats.timeouts.load());
+    out += ", time_errors=" + std::to_string(stats.timeErrors.load());
+    out += ", convert_us=" + std::to_string(stats.convertNs.load()/1000);
+    out += ", blocked_us=" + std::to_string(stats.blockedNs.load()/1000);
+    out += ", calls=" + std::to_string(calls);
+    out += ", latency_p50_us=" + std::to_string(percentile(0.50));
+    out += ", latency_p99_us=" + std::to_string(percentile(0.99));
+    out += ", latency_hist_us=" + hist;
+    return out;
+}
+
+/*******************************************************************
+ * Direct buffer access API
+ ******************************************************************/
+
+//! Index of a libbladeRF owned buffer, the buffer counts are small
+static size_t asyncBufferIndex(const AsyncStream *async, const void *samples)
+{
+    size_t i = 0;
+    while (i < async->numBuffs-1 and async->buffs[i] != samples) i++;
+    return i; //callbacks only ever see buffers from this stream
+}
+
+//! Called by libbladeRF with a filled buffer, returns the next buffer to fill
+static void *rxAsyncCallback(bladerf *, struct bladerf_stream *, bladerf_metadata *, void *samples, size_t, void *userData)
+{
+    AsyncStream *async = reinterpret_cast<AsyncStream *>(userData);
+    std::lock_guard<std::mutex> lock(async->mutex);
+    if (async->done) return BLADERF_STREAM_SHUTDOWN;
+
+    async->ready.push_back(asyncBufferIndex(async, samples));
+    async->cond.notify_one();
+
+    //the caller holds or has not yet read every other buffer:
+    //drop the oldest unread buffer and reuse it for the transfer
+    size_t next = 0;
+    if (async->free.empty())
+    {
+        next = async->ready.front();
+        async->ready.pop_front();
+        async->overflow = true;
+    }
+    else
+    {
+        next = async->free.front();
+        async->free.pop_front();
+    }
+    return async->buffs[next];
+}
+
+//! Called by libbladeRF with a sent buffer (or NULL at startup), returns the next buffer to send
+static void *txAsyncCallback(bladerf *, struct bladerf_stream *, bladerf_metadata *, void *samples, size_t, void *userData)
+{
+    AsyncStream *async = reinterpret_cast<AsyncStream *>(userData);
+    std::lock_guard<std::mutex> lock(async->mutex);
+
+    if (samples != NULL)
+    {
+        async->free.push_back(asyncBufferIndex(async, samples));
+        async->cond.notify_one();
+    }
+    if (async->done) return BLADERF_STREAM_SHUTDOWN;
+
+    //nothing to send, the transfer waits for releaseWriteBuffer()
+    if (async->ready.empty())
+    {
+        if (samples != NULL) async->underflow = true;
+        async->idleXfers++;
+        return BLADERF_STREAM_NO_DATA;
+    }
+
+    const size_t next = async->ready.front();
+    async->ready.pop_front();
+    return async->buffs[next];
+}
+
+void bladeRF_SoapySDR::startAsyncStream(AsyncStream *async)
+{
+    if (async->running) return;
+
+    const bool isTx = (async->layout == BLADERF_TX_X1 or async->layout == BLADERF_TX_X2);
+    int ret = 0;
+    async->policy.run([&](void)
+    {
+        ret = bladerf_init_stream(
+            &async->stream,
+            _dev,
+            isTx?&txAsyncCallback:&rxAsyncCallback,
+            &async->buffs,
+            async->numBuffs,
+            (async->elemBytes == 2)?BLADERF_FORMAT_SC8_Q7:BLADERF_FORMAT_SC16_Q11,
+            async->buffSize,
+            async->numXfers,
+            async);
+    });
+    if (ret != 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_init_stream() returned %s", _err2str(ret).c_str());
+        throw std::runtime_error("activateStream() " + _err2str(ret));
+    }
+
+    //rx: libbladeRF submits the first numXfers buffers itself
+    //tx: every buffer starts out available to the caller
+    async->ready.clear();
+    async->free.clear();
+    for (size_t i = isTx?0:async->numXfers; i < async->numBuffs; i++) async->free.push_back(i);
+    async->idleXfers = 0;
+    async->done = false;
+    async->overflow = false;
+    async->underflow = false;
+    async->status = 0;
+    async->running = true;
+
+    async->thread = std::thread([async](void)
+    {
+        async->policy.apply("direct stream thread");
+        const int ret = bladerf_stream(async->stream, async->layout);
+        if (ret != 0) SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_stream() returned %d", ret);
+        std::lock_guard<std::mutex> lock(async->mutex);
+        async->status = ret;
+        async->running = false;
+        async->cond.notify_all();
+    });
+}
+
+void bladeRF_SoapySDR::stopAsyncStream(AsyncStream *async)
+{
+    if (async->stream == nullptr) return;
+
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        async->done = true;
+    }
+
+    //tx transfers may all be idle, submit a shutdown so the stream returns
+    const bool isTx = (async->layout == BLADERF_TX_X1 or async->layout == BLADERF_TX_X2);
+    if (isTx) bladerf_submit_stream_buffer_nb(async->stream, BLADERF_STREAM_SHUTDOWN);
+
+    async->thread.join();
+    bladerf_deinit_stream(async->stream);
+    async->stream = nullptr;
+    async->buffs = nullptr;
+    async->ready.clear();
+    async->free.clear();
+}
+
+size_t bladeRF_SoapySDR::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
+{
+    AsyncStream *async = reinterpret_cast<StreamState *>(stream)->async;
+    if (async == nullptr) return 0;
+    return async->numBuffs;
+}
+
+int bladeRF_SoapySDR::getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs)
+{
+    AsyncStream *async = reinterpret_cast<StreamState *>(stream)->async;
+    if (async == nullptr) return SOAPY_SDR_NOT_SUPPORTED;
+
+    //buffers are allocated by libbladeRF when the stream is activated
+    if (async->buffs == nullptr or handle >= async->numBuffs) return SOAPY_SDR_STREAM_ERROR;
+    buffs[0] = async->buffs[handle];
+    return 0;
+}
+
+int bladeRF_SoapySDR::acquireReadBuffer(
+    SoapySDR::Stream *stream,
+    size_t &handle,
+    const void **buffs,
+    int &flags,
+    long long &timeNs,
+    const long timeoutUs)
+{
+    AsyncStream *async = reinterpret_cast<StreamState *>(stream)->async;
+    if (async == nullptr) return SOAPY_SDR_NOT_SUPPORTED;
+
+    //clear output metadata, timestamps are not available without meta
+    flags = 0;
+    timeNs = 0;
+
+    std::unique_lock<std::mutex> lock(async->mutex);
+    if (not async->cond.wait_for(lock, std::chrono::microseconds(timeoutUs),
+        [async]{return not async->ready.empty() or not async->running;})) return SOAPY_SDR_TIMEOUT;
+
+    //the stream thread exited on an error
+    if (not async->running) return (async->status == 0)?SOAPY_SDR_TIMEOUT:SOAPY_SDR_STREAM_ERROR;
+
+    //return overflow status indicator
+    if (async->overflow)
+    {
+        async->overflow = false;
+        SoapySDR::log(SOAPY_SDR_SSI, "O");
+        return SOAPY_SDR_OVERFLOW;
+    }
+
+    handle = async->ready.front();
+    async->ready.pop_front();
+    buffs[0] = async->buffs[handle];
+    return async->buffSize;
+}
+
+void bladeRF_SoapySDR::releaseReadBuffer(
+    SoapySDR::Stream *stream,
+    const size_t handle)
+{
+    AsyncStream *async = reinterpret_cast<StreamState *>(stream)->async;
+    if (async == nullptr) throw std::runtime_error("releaseReadBuffer() not a direct access stream");
+
+    std::lock_guard<std::mutex> lock(async->mutex);
+    async->free.push_back(handle);
+}
+
+int bladeRF_SoapySDR::acquireWriteBuffer(
+    SoapySDR::Stream *stream,
+    size_t &handle,
+    void **buffs,
+    const long timeoutUs)
+{
+    AsyncStream *async = reinterpret_cast<StreamState *>(stream)->async;
+    if (async == nullptr) return SOAPY_SDR_NOT_SUPPORTED;
+
+    std::unique_lock<std::mutex> lock(async->mutex);
+    if (not async->cond.wait_for(lock, std::chrono::microseconds(timeoutUs),
+        [async]{return not async->free.empty() or not async->running;})) return SOAPY_SDR_TIMEOUT;
+
+    //the stream thread exited on an error
+    if (not async->running) return (async->status == 0)?SOAPY_SDR_TIMEOUT:SOAPY_SDR_STREAM_ERROR;
+
+    handle = async->free.front();
+    async->free.pop_front();
+    buffs[0] = async->buffs[handle];
+    return async->buffSize;
+}
+
+void bladeRF_SoapySDR::releaseWriteBuffer(
+    SoapySDR::Stream *stream,
+    const size_t handle,
+    const size_t numElems,
+    int &flags,
+    const long long)
+{
+    AsyncStream *async = reinterpret_cast<StreamState *>(stream)->async;
+    if (async == nullptr) throw std::runtime_error("releaseWriteBuffer() not a direct access stream");
+
+    //transfers are always full buffers, pad the remainder with zeros
+    if (numElems < async->buffSize)
+    {
+        char *samples = reinterpret_cast<char *>(async->buffs[handle]);
+        std::memset(samples + numElems*async->elemBytes, 0, (async->buffSize - numElems)*async->elemBytes);
+    }
+
+    //hand the buffer directly to an idle transfer or queue it for the callback
+    bool submit = false;
+    bool underflow = false;
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        if (async->idleXfers > 0)
+        {
+            async->idleXfers--;
+            submit = true;
+        }
+        else async->ready.push_back(handle);
+        std::swap(underflow, async->underflow);
+    }
+
+    //never submit while holding the lock, libbladeRF holds its own lock in the callback
+    if (submit)
+    {
+        const int ret = bladerf_submit_stream_buffer(async->stream, async->buffs[handle], 100/*ms*/);
+        if (ret != 0)
+        {
+            //the samples are lost, the buffer and the transfer are not
+            SoapySDR::logf(SOAPY_SDR_ERROR, "bladerf_submit_stream_buffer() returned %s", _err2str(ret).c_str());
+            std::lock_guard<std::mutex> lock(async->mutex);
+            async->idleXfers++;
+            async->free.push_back(handle);
+            async->cond.notify_one();
+            underflow = true;
+        }
+    }
+
+    //parse the status
+    if (underflow)
+    {
+        SoapySDR::log(SOAPY_SDR_SSI, "U");
+        StreamMetadata resp;
+        resp.flags = 0;
+        resp.code = SOAPY_SDR_UNDERFLOW;
+        this->pushTxResp(reinterpret_cast<StreamState *>(stream), resp);
+    }
+}
@@ -0,0 +1,178 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bladeRF_ThreadPolicy.hpp"
+#include <SoapySDR/Logger.hpp>
+#include <stdexcept>
+#include <exception>
+#include <thread>
+#include <cstdlib> //atoi
+#include <cstring> //strerror
+#include <cerrno>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+//memory policy mode from linux/mempolicy.h, allocations fall back to other nodes when full
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static std::vector<int> parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        const std::string item = list.substr(pos, end-pos);
+        pos = end+1;
+        if (item.empty()) continue;
+
+        const size_t dash = item.find('-');
+        const int first = std::atoi(item.substr(0, dash).c_str());
+        const int last = (dash == std::string::npos)?first:std::atoi(item.substr(dash+1).c_str());
+        if (first < 0 or last < first) throw std::runtime_error("cpu_affinity invalid cpu range " + item);
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+//! The NUMA node of a cpu from sysfs, -1 when unknown
+static int cpuNumaNode(const int cpu)
+{
+    #ifdef __linux__
+    const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) return -1;
+    int node = -1;
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (std::strncmp(entry->d_name, "node", 4) != 0) continue;
+        node = std::atoi(entry->d_name+4);
+        break;
+    }
+    closedir(dir);
+    return node;
+    #else
+    return -1;
+    #endif
+}
+
+ThreadPolicy ThreadPolicy::fromArgs(const SoapySDR::Kwargs &args, const ThreadPolicy &defaults)
+{
+    ThreadPolicy policy = defaults;
+
+    if (args.count("cpu_affinity") != 0) policy.cpus = parseCpuList(args.at("cpu_affinity"));
+
+    if (args.count("rt_priority") != 0)
+    {
+        policy.priority = std::atoi(args.at("rt_priority").c_str());
+        if (policy.priority < 0 or policy.priority > 99) throw std::runtime_error("rt_priority must be within 0-99");
+    }
+
+    if (args.count("numa_node") != 0)
+    {
+        const std::string &node = args.at("numa_node");
+        if (node.empty()) policy.numaNode = -1;
+        else if (node != "local") policy.numaNode = std::atoi(node.c_str());
+        else
+        {
+            #ifdef __linux__
+            const int cpu = policy.cpus.empty()?sched_getcpu():policy.cpus.front();
+            policy.numaNode = cpuNumaNode(cpu);
+            #endif
+            if (policy.numaNode < 0) SoapySDR::logf(SOAPY_SDR_WARNING, "numa_node=local could not find the node of the cpu");
+        }
+    }
+
+    return policy;
+}
+
+void ThreadPolicy::apply(const std::string &what) const
+{
+    if (this->empty()) return;
+
+    #ifdef __linux__
+    if (not cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto cpu : cpus) CPU_SET(cpu, &set);
+        const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0) SoapySDR::logf(SOAPY_SDR_WARNING, "%s pthread_setaffinity_np(%s) failed: %s", what.c_str(), this->cpuList().c_str(), strerror(ret));
+    }
+
+    //needs CAP_SYS_NICE or an RLIMIT_RTPRIO of at least the priority
+    if (priority > 0)
+    {
+        struct sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        const int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0) SoapySDR::logf(SOAPY_SDR_WARNING, "%s SCHED_FIFO priority %d failed: %s", what.c_str(), priority, strerror(ret));
+    }
+
+    //pages this thread touches first are taken from the node, the thread's children inherit it
+    if (numaNode >= int(8*sizeof(unsigned long)))
+    {
+        SoapySDR::logf(SOAPY_SDR_WARNING, "%s numa node %d is not supported", what.c_str(), numaNode);
+    }
+    else if (numaNode >= 0)
+    {
+        const unsigned long mask = 1UL << numaNode;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, 8*sizeof(mask)+1) != 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "%s set_mempolicy(node %d) failed: %s", what.c_str(), numaNode, strerror(errno));
+        }
+    }
+    #else
+    SoapySDR::logf(SOAPY_SDR_WARNING, "%s thread policy is not supported on this platform", what.c_str());
+    #endif
+}
+
+void ThreadPolicy::run(const std::function<void(void)> &fcn) const
+{
+    if (this->empty()) return fcn();
+
+    std::exception_ptr error;
+    std::thread thread([&](void)
+    {
+        this->apply("setup");
+        try {fcn();}
+        catch (...) {error = std::current_exception();}
+    });
+    thread.join();
+    if (error) std::rethrow_exception(error);
+}
+
+std::string ThreadPolicy::cpuList(void) const
+{
+    std::string list;
+    for (const auto cpu : cpus) list += (list.empty()?"":",") + std::to_string(cpu);
+    return list;
+}
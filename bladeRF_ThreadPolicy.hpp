@@ -0,0 +1,67 @@
+/*
+ * This file is part of the bladeRF project:
+ *   http://www.github.com/nuand/bladeRF
+ *
+ * Copyright (C) 2015-2022 Josh Blum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <SoapySDR/Types.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*!
+ * CPU affinity, realtime priority, and NUMA node for the streaming threads
+ * and their buffers. Threads that libbladeRF creates inherit the policy
+ * when they are started from run(). The default policy changes nothing.
+ */
+struct ThreadPolicy
+{
+    ThreadPolicy(void):
+        priority(0),
+        numaNode(-1)
+    {
+        return;
+    }
+
+    /*!
+     * Parse the cpu_affinity ("0,2-3"), rt_priority (SCHED_FIFO 1-99),
+     * and numa_node (a node number or "local" for the node of the first cpu) args.
+     * Absent keys keep the values of the defaults.
+     */
+    static ThreadPolicy fromArgs(const SoapySDR::Kwargs &args, const ThreadPolicy &defaults = ThreadPolicy());
+
+    bool empty(void) const
+    {
+        return cpus.empty() and priority == 0 and numaNode < 0;
+    }
+
+    //! Apply the policy to the calling thread, failures are logged and leave the thread as it was
+    void apply(const std::string &what) const;
+
+    //! Call a function on a thread with the policy applied, exceptions are passed on
+    void run(const std::function<void(void)> &fcn) const;
+
+    //! Format the cpus like the cpu_affinity arg
+    std::string cpuList(void) const;
+
+    std::vector<int> cpus; //empty leaves the affinity
+    int priority; //SCHED_FIFO priority, 0 leaves the scheduler
+    int numaNode; //preferred memory node, -1 for none
+};